@@ -19,6 +19,8 @@ struct block
 
     unsigned long long read_cnt;        
     unsigned long long write_cnt;       
+    unsigned long long cache_hit_cnt;   /* Sectors found in a cache. */
+    unsigned long long cache_miss_cnt;  /* Sectors a cache had to read. */
   };
 
 
@@ -171,13 +173,29 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->cache_hit_cnt + block->cache_miss_cnt > 0)
+            printf (", %llu cache hits, %llu cache misses",
+                    block->cache_hit_cnt, block->cache_miss_cnt);
+          printf ("\n");
         }
     }
 }
 
+/* Records that a cache of BLOCK's sectors was asked for a
+   sector that it held, if HIT is true, or had to read it from
+   BLOCK, if HIT is false. */
+void
+block_count_cache (struct block *block, bool hit)
+{
+  if (hit)
+    block->cache_hit_cnt++;
+  else
+    block->cache_miss_cnt++;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +218,8 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->cache_hit_cnt = 0;
+  block->cache_miss_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -4,14 +4,25 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/heap-prof.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#include "vm/workset.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #endif
 
 
@@ -132,10 +143,21 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  inode_print_stats ();
 #endif
   console_print_stats ();
+  heap_prof_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
+  prefetch_print_stats ();
+  swap_print_stats ();
+  workset_print_stats ();
+#endif
 }
@@ -0,0 +1,64 @@
+/* execbench.c
+
+   Measures how fast processes can be started and torn down: the
+   parent runs ROUNDS iterations of exec() followed by wait(),
+   each starting a copy of this program that exits at once.  Every
+   iteration creates the child's page directory and page tables
+   and destroys them again, so this mostly measures the cost of
+   setting up and tearing down an address space.
+
+   Times are in CPU cycles, read with the RDTSC instruction.  If
+   the CPU clock rate in MHz is given as the only argument, the
+   rate is also reported in iterations per second. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Number of exec()/wait() iterations timed. */
+#define ROUNDS 100
+
+/* Command line that makes a copy of this program exit at once. */
+#define CHILD_CMD "execbench -child"
+
+/* Returns the CPU's time-stamp counter. */
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned long long t;
+  asm volatile ("rdtsc" : "=A" (t));
+  return t;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long long start, per_round;
+  int round;
+
+  if (argc > 1 && !strcmp (argv[1], "-child"))
+    return EXIT_SUCCESS;
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      pid_t pid = exec (CHILD_CMD);
+      if (pid == PID_ERROR)
+        {
+          printf ("exec failed after %d iterations\n", round);
+          return EXIT_FAILURE;
+        }
+      wait (pid);
+    }
+  per_round = (rdtsc () - start) / ROUNDS;
+
+  printf ("%d exec/exit iterations\n", ROUNDS);
+  printf ("%16s %16s\n", "cycles/iter", "iters/sec");
+  if (argc > 1 && per_round > 0)
+    printf ("%16llu %16llu\n", per_round,
+            atoi (argv[1]) * 1000000ULL / per_round);
+  else
+    printf ("%16llu %16s\n", per_round, "-");
+  return EXIT_SUCCESS;
+}
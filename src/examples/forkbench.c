@@ -0,0 +1,72 @@
+/* forkbench.c
+
+   Measures fork() latency as a function of the resident set
+   size of the forking process.
+
+   For each size, the parent first touches that many pages of a
+   large array, so that they are resident, then forks several
+   times.  Each child exits at once, and the parent waits for it
+   before forking again.  With copy-on-write, fork() only has to
+   share each resident page with the child, not copy it, so the
+   time per page should be small and roughly constant.
+
+   Times are in CPU cycles, read with the RDTSC instruction. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+/* Largest resident set tried, in pages.  Must fit in physical
+   memory for the measurement to be meaningful. */
+#define MAX_PAGES 256
+#define PAGE_SIZE 4096
+
+/* Number of forks timed at each size. */
+#define ROUNDS 8
+
+static char buf[MAX_PAGES * PAGE_SIZE];
+
+/* Returns the CPU's time-stamp counter. */
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned long long t;
+  asm volatile ("rdtsc" : "=A" (t));
+  return t;
+}
+
+int
+main (void) 
+{
+  size_t pages;
+
+  printf ("%10s %16s %16s\n", "pages", "cycles/fork", "cycles/page");
+  for (pages = 0; pages <= MAX_PAGES; pages = pages ? pages * 4 : 1)
+    {
+      unsigned long long total = 0;
+      size_t i;
+      int round;
+
+      for (i = 0; i < pages; i++)
+        buf[i * PAGE_SIZE] = i;
+
+      for (round = 0; round < ROUNDS; round++)
+        {
+          unsigned long long start = rdtsc ();
+          pid_t pid = fork ();
+
+          if (pid == 0)
+            exit (0);
+          total += rdtsc () - start;
+          if (pid == PID_ERROR) 
+            {
+              printf ("fork failed at %zu pages\n", pages);
+              return EXIT_FAILURE;
+            }
+          wait (pid);
+        }
+
+      printf ("%10zu %16llu %16llu\n", pages, total / ROUNDS,
+              pages ? total / ROUNDS / pages : 0);
+    }
+  return EXIT_SUCCESS;
+}
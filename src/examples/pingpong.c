@@ -0,0 +1,114 @@
+/* pingpong.c
+
+   Measures the cost of switching between two user processes.
+
+   The parent creates a one-page file, maps it, and starts a copy
+   of itself that maps the same file.  Both mappings share one
+   frame, so the two processes see the same counter.  They take
+   turns incrementing it: the parent moves it from even to odd,
+   the child from odd to even, and each yields the CPU while it
+   waits for its turn.  With no other process runnable, each
+   yield switches straight to the other process, so a round trip
+   costs two context switches and the TLB misses that follow
+   them, which is what keeping kernel mappings global in the TLB
+   is meant to reduce.
+
+   Times are in CPU cycles, read with the RDTSC instruction. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Number of round trips timed. */
+#define ROUNDS 1000
+
+/* File shared by the two processes, and where it is mapped. */
+#define FILE_NAME "pingpong.dat"
+#define PAGE_SIZE 4096
+#define MAP_ADDR ((void *) 0x10000000)
+
+/* Command line that starts the child side. */
+#define CHILD_CMD "pingpong -child"
+
+/* Returns the CPU's time-stamp counter. */
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned long long t;
+  asm volatile ("rdtsc" : "=A" (t));
+  return t;
+}
+
+/* Maps FILE_NAME at MAP_ADDR and returns the shared words in
+   it: the counter, followed by a flag that the child sets once it
+   is ready to play.  Returns a null pointer on failure. */
+static volatile int *
+map_counter (void)
+{
+  int fd = open (FILE_NAME);
+  if (fd < 0 || mmap (fd, MAP_ADDR) == MAP_FAILED)
+    return NULL;
+  return MAP_ADDR;
+}
+
+/* Takes ROUNDS turns at COUNTER, each time waiting, yielding the
+   CPU, until its parity is PARITY and then incrementing it. */
+static void
+play (volatile int *counter, int parity)
+{
+  int round;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      while (*counter % 2 != parity)
+        yield ();
+      ++*counter;
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  volatile int *counter;
+  unsigned long long start, elapsed;
+  pid_t pid;
+
+  if (argc > 1 && !strcmp (argv[1], "-child"))
+    {
+      counter = map_counter ();
+      if (counter == NULL)
+        return EXIT_FAILURE;
+      counter[1] = 1;
+      play (counter, 1);
+      return EXIT_SUCCESS;
+    }
+
+  remove (FILE_NAME);
+  if (!create (FILE_NAME, PAGE_SIZE) || (counter = map_counter ()) == NULL)
+    {
+      printf ("%s: create or mmap failed\n", FILE_NAME);
+      return EXIT_FAILURE;
+    }
+
+  /* Start the clock only once the child has mapped the file. */
+  pid = exec (CHILD_CMD);
+  if (pid == PID_ERROR)
+    {
+      printf ("exec failed\n");
+      return EXIT_FAILURE;
+    }
+  while (!counter[1])
+    yield ();
+
+  start = rdtsc ();
+  play (counter, 0);
+  while (*counter != 2 * ROUNDS)
+    yield ();
+  elapsed = rdtsc () - start;
+  wait (pid);
+
+  printf ("%d round trips\n", ROUNDS);
+  printf ("%16s\n", "cycles/trip");
+  printf ("%16llu\n", elapsed / ROUNDS);
+  return EXIT_SUCCESS;
+}
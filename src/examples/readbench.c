@@ -0,0 +1,86 @@
+/* readbench.c
+
+   Measures sequential read throughput, for the same workloads as
+   the sm-seq-block and lg-seq-block tests: a file of 5,678 or
+   75,678 bytes written and then read back 513 bytes at a time.
+   The large file does not fit in the buffer cache, so reading
+   it back goes to disk, and with read-ahead the next sectors
+   should already be on their way by the time they are wanted.
+
+   Each file is created, written, and closed, then read back
+   ROUNDS times, each time through a newly opened file.  Times
+   are in CPU cycles, read with the RDTSC instruction. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of each read or write, in bytes. */
+#define BLOCK_SIZE 513
+
+/* Number of times each file is read. */
+#define ROUNDS 4
+
+static char buf[BLOCK_SIZE];
+
+/* Returns the CPU's time-stamp counter. */
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned long long t;
+  asm volatile ("rdtsc" : "=A" (t));
+  return t;
+}
+
+/* Creates FILE_NAME with SIZE bytes, then reads it back and
+   prints the throughput.  Returns true if successful. */
+static bool
+bench (const char *file_name, size_t size)
+{
+  unsigned long long total = 0;
+  size_t ofs;
+  int round;
+  int fd;
+
+  if (!create (file_name, size) || (fd = open (file_name)) < 0)
+    {
+      printf ("%s: create failed\n", file_name);
+      return false;
+    }
+  memset (buf, 'x', sizeof buf);
+  for (ofs = 0; ofs < size; ofs += BLOCK_SIZE)
+    write (fd, buf, size - ofs < BLOCK_SIZE ? size - ofs : BLOCK_SIZE);
+  close (fd);
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      unsigned long long start;
+
+      fd = open (file_name);
+      if (fd < 0)
+        {
+          printf ("%s: open failed\n", file_name);
+          return false;
+        }
+      start = rdtsc ();
+      while (read (fd, buf, BLOCK_SIZE) > 0)
+        continue;
+      total += rdtsc () - start;
+      close (fd);
+    }
+  remove (file_name);
+
+  printf ("%10s %10zu %16llu %16llu\n", file_name, size, total / ROUNDS,
+          (unsigned long long) size * ROUNDS * 1000000 / 1024 / total);
+  return true;
+}
+
+int
+main (void)
+{
+  printf ("%10s %10s %16s %16s\n",
+          "file", "bytes", "cycles/read", "kB/Mcycle");
+  if (!bench ("sm-seq", 5678) || !bench ("lg-seq", 75678))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -1,10 +1,12 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syscall.h>
 
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static void print_memstat (pid_t);
 
 int
 main (void)
@@ -26,6 +28,15 @@ main (void)
           if (!chdir (command + 3))
             printf ("\"%s\": chdir failed\n", command + 3);
         }
+      else if (!strcmp (command, "mem"))
+        print_memstat (MEMSTAT_SELF);
+      else if (!memcmp (command, "mem ", 4))
+        print_memstat (atoi (command + 4));
+      else if (!memcmp (command, "limit ", 6)) 
+        {
+          if (!memlimit (MEMSTAT_SELF, atoi (command + 6)))
+            printf ("limit failed\n");
+        }
       else if (command[0] == '\0') 
         {
           
@@ -102,3 +113,24 @@ backspace (char **pos, char line[])
   else
     return false;
 }
+
+/* Prints the memory use of process PID, or of the shell if PID
+   is MEMSTAT_SELF.  Programs run from the shell inherit its
+   resident set limit, which the "limit" command sets. */
+static void
+print_memstat (pid_t pid) 
+{
+  struct memstat m;
+
+  if (!memstat (pid, &m))
+    {
+      printf ("mem failed\n");
+      return;
+    }
+  printf ("%zu pages resident, %zu in working set, %zu evicted, ",
+          m.resident, m.working_set, m.evicted);
+  if (m.resident_limit == MEMSTAT_NO_LIMIT)
+    printf ("no limit\n");
+  else
+    printf ("limit %zu\n", m.resident_limit);
+}
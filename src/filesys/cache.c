@@ -0,0 +1,510 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   Keeps CACHE_CNT sectors of the file system device in memory,
+   so that inode and directory sectors that are used again and
+   again, and file data that is read or written in small pieces,
+   cost a memcpy() instead of a disk transfer.  Writes go only to
+   the cache; a modified block is written back to disk when it is
+   evicted, when cache_flush() is called, or by the flusher
+   thread once it has been dirty for cache_dirty_ms.  The flusher
+   also writes any dirty blocks that hold the sectors next to
+   those, so that runs of adjacent sectors go to disk together,
+   in order.  If more than DIRTY_LIMIT blocks are dirty anyway, a
+   thread that dirties another block writes back a few of them
+   itself before going on, which bounds both the number of dirty
+   blocks and how long any one writer has to wait.
+
+   To use a sector, lock its block with cache_lock(), get at its
+   data with cache_read() or cache_zero(), mark it dirty with
+   cache_dirty() if it was modified, and unlock it with
+   cache_unlock().  Each block has its own lock, so that threads
+   using different sectors do not wait for each other.
+
+   CACHE_SYNC protects the mapping from sectors to blocks.  A
+   thread that finds the sector it wants in a block that is
+   locked counts itself in the block's WAITERS before releasing
+   CACHE_SYNC to wait for the block's lock, and a block with
+   waiters is never chosen for eviction, so the block still holds
+   the same sector once the lock is obtained.  Victims are chosen
+   by the clock algorithm.  A dirty victim is written back while
+   CACHE_SYNC is held, so that no thread can read the victim's
+   old sector from disk before its new contents are there.
+
+   cache_read_ahead() queues a sector to be read into the cache
+   by a background thread, so that a process reading a file
+   sequentially finds the next sectors in memory instead of
+   waiting for the disk.  Blocks read ahead are not marked
+   accessed, so if they go unused they are the first to be
+   evicted. */
+
+/* Number of cached sectors. */
+#define CACHE_CNT 64
+
+/* Sector value of an unused block. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* A cached sector. */
+struct cache_block
+  {
+    struct lock lock;           /* Held by the block's user. */
+    block_sector_t sector;      /* Sector, or NO_SECTOR if unused. */
+    int waiters;                /* Threads waiting for LOCK. */
+    bool up_to_date;            /* DATA holds the sector's contents? */
+    bool dirty;                 /* DATA must be written back? */
+    bool accessed;              /* Used since clock hand passed? */
+    bool read_ahead;            /* Read ahead, not yet used? */
+    int64_t dirty_time;         /* Timer tick when DIRTY was set. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_block cache[CACHE_CNT];
+static struct lock cache_sync;
+static size_t hand;
+
+/* Sectors to read ahead, as a ring buffer. */
+#define QUEUE_SIZE 32
+static block_sector_t queue[QUEUE_SIZE];
+static size_t head, tail;       /* Next to dequeue, next to enqueue. */
+static struct lock queue_lock;
+static struct semaphore queue_cnt;
+
+/* Read-ahead statistics. */
+static unsigned long long read_ahead_cnt;   /* Sectors read ahead. */
+static unsigned long long used_cnt;         /* ...and later used. */
+static unsigned long long skip_cnt;         /* Requests not needed. */
+
+/* Age at which the flusher writes back a dirty block. */
+unsigned cache_dirty_ms = CACHE_DIRTY_MS_DEFAULT;
+
+/* Number of dirty blocks. */
+static size_t dirty_cnt;
+
+/* Dirty blocks above which writers are throttled, and the most
+   blocks a throttled writer writes back. */
+#define DIRTY_LIMIT (CACHE_CNT * 3 / 4)
+#define THROTTLE_BATCH 8
+
+/* Write-behind statistics. */
+static unsigned long long flush_cnt;        /* Blocks written by flusher. */
+static unsigned long long throttle_cnt;     /* Writers throttled. */
+static unsigned long long throttle_write_cnt; /* Blocks they wrote. */
+
+static thread_func read_ahead_thread NO_RETURN;
+static thread_func flush_thread NO_RETURN;
+
+/* Sets up the buffer cache. */
+void
+cache_init (void)
+{
+  uint8_t *data;
+  size_t i;
+
+  data = palloc_get_multiple (PAL_ASSERT,
+                              CACHE_CNT * BLOCK_SECTOR_SIZE / PGSIZE);
+  lock_init (&cache_sync);
+  lock_init (&queue_lock);
+  sema_init (&queue_cnt, 0);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_block *b = &cache[i];
+      lock_init (&b->lock);
+      b->sector = NO_SECTOR;
+      b->waiters = 0;
+      b->up_to_date = false;
+      b->dirty = false;
+      b->accessed = false;
+      b->read_ahead = false;
+      b->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  thread_create ("readahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  thread_create ("flush", PRI_DEFAULT, flush_thread, NULL);
+}
+
+/* Adds DELTA to dirty_cnt. */
+static void
+count_dirty (int delta)
+{
+  enum intr_level old_level = intr_disable ();
+  dirty_cnt += delta;
+  intr_set_level (old_level);
+}
+
+/* Marks locked block B dirty, noting when it became dirty. */
+static void
+mark_dirty (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  if (!b->dirty)
+    {
+      b->dirty = true;
+      b->dirty_time = timer_ticks ();
+      count_dirty (1);
+    }
+}
+
+/* Writes locked block B back to disk if it is dirty. */
+static void
+write_back (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  if (b->dirty)
+    {
+      block_write (fs_device, b->sector, b->data);
+      b->dirty = false;
+      count_dirty (-1);
+    }
+}
+
+/* A dirty block considered by write_back_old(). */
+struct candidate
+  {
+    block_sector_t sector;      /* Block's sector when chosen. */
+    uint8_t idx;                /* Index of block in cache[]. */
+    bool old;                   /* Dirty since before the cutoff? */
+  };
+
+/* Writes back, in order of sector number, every run of dirty
+   blocks that hold adjacent sectors and include a block that has
+   been dirty since CUTOFF or earlier, up to MAX blocks in all.
+   If WAIT is false, blocks that are in use are skipped instead of
+   waited for.  Returns the number of blocks written. */
+static size_t
+write_back_old (int64_t cutoff, size_t max, bool wait)
+{
+  struct candidate c[CACHE_CNT];
+  size_t cnt = 0;
+  size_t written = 0;
+  size_t i, j;
+
+  /* Take a snapshot of the dirty blocks, sorted by sector. */
+  lock_acquire (&cache_sync);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_block *b = &cache[i];
+      if (b->sector == NO_SECTOR || !b->dirty)
+        continue;
+      for (j = cnt++; j > 0 && c[j - 1].sector > b->sector; j--)
+        c[j] = c[j - 1];
+      c[j].idx = i;
+      c[j].sector = b->sector;
+      c[j].old = b->dirty_time <= cutoff;
+    }
+  lock_release (&cache_sync);
+
+  /* Write each run [I, J) that includes an old block. */
+  for (i = 0; i < cnt && written < max; i = j)
+    {
+      bool old = false;
+
+      for (j = i; j < cnt && (j == i || c[j].sector == c[j - 1].sector + 1);
+           j++)
+        old = old || c[j].old;
+      if (!old)
+        continue;
+
+      for (; i < j && written < max; i++)
+        {
+          struct cache_block *b = &cache[c[i].idx];
+
+          if (wait)
+            lock_acquire (&b->lock);
+          else if (!lock_try_acquire (&b->lock))
+            continue;
+          if (b->sector == c[i].sector && b->dirty)
+            {
+              write_back (b);
+              written++;
+            }
+          lock_release (&b->lock);
+        }
+    }
+  return written;
+}
+
+/* Writes every dirty block back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_block *b = &cache[i];
+      lock_acquire (&b->lock);
+      if (b->sector != NO_SECTOR)
+        write_back (b);
+      lock_release (&b->lock);
+    }
+}
+
+/* Returns the block that holds SECTOR, or a null pointer if
+   there is none.  The caller must hold cache_sync. */
+static struct cache_block *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_sync));
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an unused block, or failing that evicts one, and
+   returns it, locked and empty.  The caller must hold
+   cache_sync. */
+static struct cache_block *
+evict (void)
+{
+  ASSERT (lock_held_by_current_thread (&cache_sync));
+
+  for (;;)
+    {
+      struct cache_block *b = &cache[hand];
+      if (++hand >= CACHE_CNT)
+        hand = 0;
+
+      if (b->waiters > 0 || !lock_try_acquire (&b->lock))
+        continue;
+      if (b->sector == NO_SECTOR)
+        return b;
+      if (b->accessed)
+        {
+          b->accessed = false;
+          lock_release (&b->lock);
+          continue;
+        }
+
+      write_back (b);
+      b->sector = NO_SECTOR;
+      b->up_to_date = false;
+      b->read_ahead = false;
+      return b;
+    }
+}
+
+/* Locks the block that caches SECTOR, assigning a block to it if
+   necessary, and returns it.  The block's data is not
+   necessarily read in yet: use cache_read() or cache_zero(). */
+struct cache_block *
+cache_lock (block_sector_t sector)
+{
+  struct cache_block *b;
+
+  ASSERT (sector != NO_SECTOR);
+
+  lock_acquire (&cache_sync);
+  b = lookup (sector);
+  if (b != NULL)
+    {
+      b->waiters++;
+      lock_release (&cache_sync);
+      lock_acquire (&b->lock);
+
+      lock_acquire (&cache_sync);
+      b->waiters--;
+      lock_release (&cache_sync);
+      ASSERT (b->sector == sector);
+    }
+  else
+    {
+      b = evict ();
+      b->sector = sector;
+      lock_release (&cache_sync);
+    }
+  b->accessed = true;
+  return b;
+}
+
+/* Returns locked block B's data, reading it from disk first if
+   it is not already in memory. */
+void *
+cache_read (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  block_count_cache (fs_device, b->up_to_date);
+  if (b->read_ahead)
+    {
+      used_cnt++;
+      b->read_ahead = false;
+    }
+  if (!b->up_to_date)
+    {
+      ASSERT (!b->dirty);
+      block_read (fs_device, b->sector, b->data);
+      b->up_to_date = true;
+    }
+  return b->data;
+}
+
+/* Fills locked block B with zeros, without reading it from
+   disk, marks it dirty, and returns its data. */
+void *
+cache_zero (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  memset (b->data, 0, BLOCK_SECTOR_SIZE);
+  b->read_ahead = false;
+  b->up_to_date = true;
+  mark_dirty (b);
+  return b->data;
+}
+
+/* Marks locked block B as modified, so that it will be written
+   back to disk. */
+void
+cache_dirty (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  ASSERT (b->up_to_date);
+  mark_dirty (b);
+}
+
+/* Unlocks block B.  If B is dirty and too many other blocks are
+   dirty too, writes back a few of them first. */
+void
+cache_unlock (struct cache_block *b)
+{
+  bool dirty = b->dirty;
+
+  ASSERT (lock_held_by_current_thread (&b->lock));
+  lock_release (&b->lock);
+
+  if (dirty && dirty_cnt > DIRTY_LIMIT)
+    {
+      throttle_cnt++;
+      throttle_write_cnt += write_back_old (timer_ticks (), THROTTLE_BATCH,
+                                            false);
+    }
+}
+
+/* Drops SECTOR, which has been freed, from the cache without
+   writing it back. */
+void
+cache_free (block_sector_t sector)
+{
+  struct cache_block *b;
+
+  lock_acquire (&cache_sync);
+  b = lookup (sector);
+  if (b == NULL)
+    {
+      lock_release (&cache_sync);
+      return;
+    }
+  b->waiters++;
+  lock_release (&cache_sync);
+  lock_acquire (&b->lock);
+
+  lock_acquire (&cache_sync);
+  b->waiters--;
+  b->sector = NO_SECTOR;
+  b->up_to_date = false;
+  if (b->dirty)
+    {
+      b->dirty = false;
+      count_dirty (-1);
+    }
+  b->read_ahead = false;
+  lock_release (&cache_sync);
+  lock_release (&b->lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+   Does not wait. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  bool queued = false;
+
+  lock_acquire (&queue_lock);
+  if ((tail + 1) % QUEUE_SIZE != head)
+    {
+      queue[tail] = sector;
+      tail = (tail + 1) % QUEUE_SIZE;
+      queued = true;
+    }
+  else
+    skip_cnt++;
+  lock_release (&queue_lock);
+
+  if (queued)
+    sema_up (&queue_cnt);
+}
+
+/* Reads the sectors queued by cache_read_ahead() that are not
+   already in the cache. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_block *b;
+
+      sema_down (&queue_cnt);
+      lock_acquire (&queue_lock);
+      sector = queue[head];
+      head = (head + 1) % QUEUE_SIZE;
+      lock_release (&queue_lock);
+
+      lock_acquire (&cache_sync);
+      if (lookup (sector) != NULL)
+        {
+          lock_release (&cache_sync);
+          skip_cnt++;
+          continue;
+        }
+      b = evict ();
+      b->sector = sector;
+      lock_release (&cache_sync);
+
+      block_read (fs_device, sector, b->data);
+      b->up_to_date = true;
+      b->dirty = false;
+      b->read_ahead = true;
+      read_ahead_cnt++;
+      lock_release (&b->lock);
+    }
+}
+
+/* Every half of cache_dirty_ms, writes back the blocks that have
+   been dirty for longer than that. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      int64_t age = (int64_t) cache_dirty_ms * TIMER_FREQ / 1000;
+
+      timer_sleep (age / 2 > 0 ? age / 2 : 1);
+      flush_cnt += write_back_old (timer_ticks () - age, CACHE_CNT, true);
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu sectors read ahead, %llu used, %llu skipped\n",
+          read_ahead_cnt, used_cnt, skip_cnt);
+  printf ("Cache: %zu dirty, %llu written behind, "
+          "%llu writers throttled, %llu written by them\n",
+          dirty_cnt, flush_cnt, throttle_cnt, throttle_write_cnt);
+}
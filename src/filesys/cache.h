@@ -0,0 +1,26 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+struct cache_block;
+
+/* Age, in milliseconds, at which dirty blocks are written back
+   in the background. */
+#define CACHE_DIRTY_MS_DEFAULT 1000
+extern unsigned cache_dirty_ms;
+
+void cache_init (void);
+void cache_flush (void);
+
+struct cache_block *cache_lock (block_sector_t);
+void *cache_read (struct cache_block *);
+void *cache_zero (struct cache_block *);
+void cache_dirty (struct cache_block *);
+void cache_unlock (struct cache_block *);
+void cache_free (block_sector_t);
+void cache_read_ahead (block_sector_t);
+
+void cache_print_stats (void);
+
+#endif
@@ -0,0 +1,144 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent name lookups: for a directory,
+   named by the sector of its inode, and a name in it, the sector
+   of the named file's inode, or DCACHE_NEGATIVE if there is no
+   such file.  A lookup that hits costs neither a directory open
+   nor a search of the directory, and repeated lookups of missing
+   names are answered too.
+
+   The cache is direct-mapped: each (directory, name) pair can
+   live in just one slot, chosen by hashing, and replaces whatever
+   was there.  dir_add() and dir_remove() keep the cache in step
+   with the directories they change. */
+
+#define DCACHE_CNT 512
+
+/* A cached lookup. */
+struct dentry
+  {
+    block_sector_t dir;                 /* Directory inode sector. */
+    block_sector_t sector;              /* File inode sector, or negative. */
+    char name[NAME_MAX + 1];            /* Null terminated name. */
+    bool in_use;                        /* In use or free? */
+  };
+
+static struct dentry dcache[DCACHE_CNT];
+static struct lock dcache_lock;
+
+/* Statistics. */
+static unsigned long long hit_cnt;          /* Lookups answered. */
+static unsigned long long negative_cnt;     /* ...that found no file. */
+static unsigned long long miss_cnt;         /* Lookups not answered. */
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  lock_init (&dcache_lock);
+}
+
+/* Returns the slot for NAME in DIR. */
+static struct dentry *
+slot (block_sector_t dir, const char *name)
+{
+  unsigned hash = hash_string (name) ^ hash_int (dir);
+  return &dcache[hash % DCACHE_CNT];
+}
+
+/* Returns true if dentry D is for NAME in DIR. */
+static bool
+matches (const struct dentry *d, block_sector_t dir, const char *name)
+{
+  return d->in_use && d->dir == dir && !strcmp (d->name, name);
+}
+
+/* Looks up NAME in DIR in the cache.  If found, stores the
+   sector of its inode, or DCACHE_NEGATIVE if it is known not to
+   exist, in *SECTORP and returns true.  Otherwise, returns
+   false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d = slot (dir, name);
+  bool found;
+
+  lock_acquire (&dcache_lock);
+  found = matches (d, dir, name);
+  if (found)
+    {
+      *sectorp = d->sector;
+      hit_cnt++;
+      if (d->sector == DCACHE_NEGATIVE)
+        negative_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return found;
+}
+
+/* Records that NAME in DIR refers to the inode in SECTOR, or
+   does not exist if SECTOR is DCACHE_NEGATIVE.  Names too long
+   to be in a directory are not cached. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+  d = slot (dir, name);
+  lock_acquire (&dcache_lock);
+  d->dir = dir;
+  d->sector = sector;
+  strlcpy (d->name, name, sizeof d->name);
+  d->in_use = true;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d = slot (dir, name);
+
+  lock_acquire (&dcache_lock);
+  if (matches (d, dir, name))
+    d->in_use = false;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets everything cached about names in DIR, for use when
+   DIR's inode may be deleted and its sector reused. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_CNT; i++)
+    if (dcache[i].dir == dir)
+      dcache[i].in_use = false;
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  unsigned long long total = hit_cnt + miss_cnt;
+
+  printf ("Dcache: %llu lookups, %llu hits (%llu negative), "
+          "%llu%% hit ratio\n",
+          total, hit_cnt, negative_cnt,
+          total > 0 ? hit_cnt * 100 / total : 0);
+}
@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,6 +23,35 @@ struct dir_entry
     bool in_use;                        
   };
 
+/* In-memory index of the entries in a directory, hashed by name.
+
+   The first lookup in a directory reads all of its entries once
+   to build the index, which then stays with the directory's
+   in-memory inode until the inode is freed.  After that, lookups
+   need no disk access, and dir_add() finds a free slot from a
+   hint instead of scanning the whole directory.  The directory
+   itself stays an array of struct dir_entry, so the on-disk
+   format does not change.  If memory runs out, the index is
+   dropped and the directory is searched linearly. */
+struct dir_index
+  {
+    struct hash entries;                /* Contains struct index_entry's. */
+    off_t free_ofs;                     /* No free slot before here. */
+  };
+
+/* An entry in a directory index. */
+struct index_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dir_index. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of dir_entry. */
+  };
+
+static hash_hash_func index_hash;
+static hash_less_func index_less;
+static hash_action_func free_index_entry;
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -83,6 +114,122 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns a hash value for index entry E. */
+static unsigned
+index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct index_entry *ie = hash_entry (e, struct index_entry,
+                                             hash_elem);
+  return hash_string (ie->name);
+}
+
+/* Returns true if index entry A's name precedes B's. */
+static bool
+index_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct index_entry *a = hash_entry (a_, struct index_entry,
+                                            hash_elem);
+  const struct index_entry *b = hash_entry (b_, struct index_entry,
+                                            hash_elem);
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+free_index_entry (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, hash_elem));
+}
+
+/* Adds an entry for E, at offset OFS, to INDEX.
+   Returns true if successful, false if memory is exhausted. */
+static bool
+index_add (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  struct index_entry *ie = malloc (sizeof *ie);
+  if (ie == NULL)
+    return false;
+  strlcpy (ie->name, e->name, sizeof ie->name);
+  ie->inode_sector = e->inode_sector;
+  ie->ofs = ofs;
+  hash_insert (&index->entries, &ie->hash_elem);
+  return true;
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if there is
+   none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->entries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct index_entry, hash_elem) : NULL;
+}
+
+/* Frees INDEX, which may be a null pointer. */
+void
+dir_index_destroy (struct dir_index *index)
+{
+  if (index != NULL)
+    {
+      hash_destroy (&index->entries, free_index_entry);
+      free (index);
+    }
+}
+
+/* Drops DIR's index, so that DIR is searched linearly until the
+   index is rebuilt.  Used when the index cannot be kept up to
+   date. */
+static void
+drop_index (const struct dir *dir)
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
+/* Returns DIR's index, building it if necessary, or a null
+   pointer if memory is too short to build it. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (index != NULL)
+    return index;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  if (!hash_init (&index->entries, index_hash, index_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  index->free_ofs = -1;
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (!e.in_use)
+      {
+        if (index->free_ofs < 0)
+          index->free_ofs = ofs;
+      }
+    else if (!index_add (index, &e, ofs))
+      {
+        dir_index_destroy (index);
+        return NULL;
+      }
+  if (index->free_ofs < 0)
+    index->free_ofs = ofs;
+  inode_set_dir_index (dir->inode, index);
+  return index;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +239,35 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry *ie;
+
+      if (strlen (name) > NAME_MAX)
+        return false;
+      ie = index_find (index, name);
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
+  /* No index: search linearly. */
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -119,13 +289,23 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector;
+  block_sector_t sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = (lookup (dir, name, &e, NULL)
+                ? e.inode_sector : DCACHE_NEGATIVE);
+      dcache_insert (dir_sector, name, sector);
+    }
+
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -141,6 +321,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -156,14 +337,17 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
+  /* Set OFS to offset of free slot, starting from the index's
+     hint if there is an index.
      If there are no free slots, then it will be set to the
      current end-of-file.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  index = inode_get_dir_index (dir->inode);
+  for (ofs = index != NULL ? index->free_ofs : 0;
+       inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (!e.in_use)
       break;
@@ -174,6 +358,17 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Keep the index and the dentry cache up to date. */
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  if (index != NULL)
+    {
+      if (success)
+        index->free_ofs = ofs + sizeof e;
+      if (success && !index_add (index, &e, ofs))
+        drop_index (dir);
+    }
+
  done:
   return success;
 }
@@ -184,6 +379,7 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -206,6 +402,20 @@ dir_remove (struct dir *dir, const char *name)
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
+  /* Keep the index and the dentry cache up to date.  The removed
+     file may be a directory whose sector will be reused. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  dcache_invalidate_dir (e.inode_sector);
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      hash_delete (&index->entries, &ie->hash_elem);
+      free (ie);
+      if (ofs < index->free_ofs)
+        index->free_ofs = ofs;
+    }
+
   
   inode_remove (inode);
   success = true;
@@ -12,6 +12,7 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dir_index;
 
 
 bool dir_create (block_sector_t sector, size_t entry_cnt);
@@ -26,5 +27,6 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+void dir_index_destroy (struct dir_index *);
 
 #endif 
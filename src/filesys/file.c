@@ -1,14 +1,27 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window limits, in bytes.  A file read sequentially
+   starts with a window of RA_MIN bytes past the end of each
+   read, which doubles with each further sequential read up to
+   RA_MAX bytes. */
+#define RA_MIN (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX (16 * BLOCK_SECTOR_SIZE)
+
 
 struct file 
   {
     struct inode *inode;        
     off_t pos;                  
     bool deny_write;            
+
+    /* Read-ahead state. */
+    off_t ra_next;              /* Offset where a sequential read starts. */
+    off_t ra_end;               /* End of data already read ahead. */
+    off_t ra_window;            /* Current window size, 0 if random. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +36,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = file->ra_end = file->ra_window = 0;
       return file;
     }
   else
@@ -60,6 +74,43 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* Notes that BYTES_READ bytes were just read from FILE at
+   OFFSET.  If the read continued where the previous one left
+   off, grows the read-ahead window and asks for the data in the
+   window past the read to be read into the cache in the
+   background.  Any other read closes the window. */
+static void
+read_ahead (struct file *file, off_t offset, off_t bytes_read) 
+{
+  off_t end = offset + bytes_read;
+
+  if (offset != file->ra_next || bytes_read == 0)
+    {
+      file->ra_window = 0;
+      file->ra_end = end;
+    }
+  else
+    {
+      off_t target;
+
+      if (file->ra_window == 0)
+        file->ra_window = RA_MIN;
+      else if (file->ra_window < RA_MAX)
+        file->ra_window *= 2;
+
+      if (file->ra_end < end)
+        file->ra_end = end;
+      target = end + file->ra_window;
+      if (target > file->ra_end) 
+        {
+          inode_read_ahead (file->inode, target - file->ra_end,
+                            file->ra_end);
+          file->ra_end = target;
+        }
+    }
+  file->ra_next = end;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -69,6 +120,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,7 +133,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
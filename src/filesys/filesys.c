@@ -2,6 +2,8 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
@@ -10,8 +12,21 @@
 
 struct block *fs_device;
 
+/* The root directory, kept open while the file system is in
+   use so that its in-memory inode, and with it the directory's
+   index, stays around between operations. */
+static struct dir *root_dir;
+
 static void do_format (void);
 
+/* Returns the sector that holds DIR's inode, near which the
+   inodes of new files in DIR are allocated. */
+static block_sector_t
+dir_sector (struct dir *dir)
+{
+  return inode_get_inumber (dir_get_inode (dir));
+}
+
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
 void
@@ -21,6 +36,8 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
@@ -28,6 +45,9 @@ filesys_init (bool format)
     do_format ();
 
   free_map_open ();
+  root_dir = dir_open_root ();
+  if (root_dir == NULL)
+    PANIC ("can't open root directory");
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,7 +55,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  dir_close (root_dir);
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -48,7 +70,8 @@ filesys_create (const char *name, off_t initial_size)
   block_sector_t inode_sector = 0;
   struct dir *dir = dir_open_root ();
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (1, dir_sector (dir),
+                                             &inode_sector)
                   && inode_create (inode_sector, initial_size)
                   && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
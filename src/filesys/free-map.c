@@ -1,13 +1,102 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   
 static struct bitmap *free_map;      
 
+/* The disk is divided into allocation groups of GROUP_SECTORS
+   sectors each, and the number of free sectors in each group is
+   kept, so that a search for free sectors can pass over full
+   groups without looking at their bits. */
+#define GROUP_SECTORS 1024
+static size_t group_cnt;
+static size_t *group_free;
+
+/* Adds DELTA to the free count of the group of each sector from
+   SECTOR through SECTOR + CNT - 1. */
+static void
+count_free (block_sector_t sector, size_t cnt, int delta)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    group_free[(sector + i) / GROUP_SECTORS] += delta;
+}
+
+/* Recounts the free sectors in every group. */
+static void
+count_groups (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      group_free[g] = cnt - bitmap_count (free_map, start, cnt, true);
+    }
+}
+
+/* Returns the first sector of the first run of CNT free sectors
+   at or after HINT, skipping groups with fewer than CNT free
+   sectors, and wrapping around to the start of the disk if
+   necessary.  Returns BITMAP_ERROR if there is no such run. */
+static size_t
+find_free (size_t cnt, block_sector_t hint)
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t i;
+
+  if (hint >= sector_cnt)
+    hint = 0;
+  for (i = 0; i < group_cnt; i++)
+    {
+      size_t g = (hint / GROUP_SECTORS + i) % group_cnt;
+      size_t start = i == 0 ? hint : g * GROUP_SECTORS;
+      size_t end = (g + 1) * GROUP_SECTORS;
+      size_t sector;
+
+      if (group_free[g] < cnt)
+        continue;
+      if (end > sector_cnt)
+        end = sector_cnt;
+      sector = bitmap_scan_range (free_map, start, end, cnt, false);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+
+  /* The run may span groups, or lie in HINT's group before HINT. */
+  return bitmap_scan (free_map, 0, cnt, false);
+}
+
+/* Writes the sectors of the free map file that hold bits START
+   through START + CNT - 1 of the free map, instead of the whole
+   file.  The writes go to the buffer cache, which gathers
+   repeated changes to a sector into a single disk write.
+   Returns true if successful. */
+static bool
+write_bits (size_t start, size_t cnt)
+{
+  off_t size = bitmap_file_size (free_map);
+  off_t first, last;
+
+  if (free_map_file == NULL || cnt == 0)
+    return true;
+  first = ROUND_DOWN (start / CHAR_BIT, BLOCK_SECTOR_SIZE);
+  last = ROUND_UP ((start + cnt - 1) / CHAR_BIT + 1, BLOCK_SECTOR_SIZE);
+  if (last > size)
+    last = size;
+  return bitmap_write_part (free_map, free_map_file, first, last - first);
+}
 
 void
 free_map_init (void) 
@@ -15,8 +104,13 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("allocation group creation failed");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  count_groups ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,17 +121,32 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map, as soon
+   after sector HINT as possible, and stores the first into
+   *SECTORP.  Passing the sector just after the last one
+   allocated to a file as HINT tends to keep the file contiguous.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t hint,
+                        block_sector_t *sectorp)
+{
+  size_t sector = find_free (cnt, hint);
+  if (sector == BITMAP_ERROR)
+    return false;
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (!write_bits (sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      return false;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  count_free (sector, cnt, -1);
+  *sectorp = sector;
+  return true;
 }
 
 
@@ -46,7 +155,8 @@ free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  count_free (sector, cnt, 1);
+  write_bits (sector, cnt);
 }
 
 
@@ -58,6 +168,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 
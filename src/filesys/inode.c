@@ -1,8 +1,12 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
@@ -10,16 +14,57 @@
 
 #define INODE_MAGIC 0x494e4f44
 
+/* Data sectors are found through a tree of index blocks rooted
+   in the inode.  The first DIRECT_CNT sectors of a file are
+   listed in the inode itself, the next PTRS_PER_SECTOR in an
+   indirect block, and the rest in a doubly indirect block.  A
+   sector number of 0 means "not allocated"; sector 0 holds the
+   free map's inode, so it is never a data or index sector.
+
+   Sectors are allocated one at a time, so a file never needs a
+   contiguous run of free sectors.  A write past end of file
+   allocates, and zeroes, every sector between the old end of
+   file and the end of the write.
+
+   A file of up to INLINE_MAX bytes keeps its data in the inode
+   itself, in place of the sector numbers, so that reading it
+   costs one sector instead of two.  New files start out inline,
+   and the data moves to a data sector the first time the file
+   grows past INLINE_MAX. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT 1
+#define DBL_INDIRECT_CNT 1
+#define SECTOR_CNT (DIRECT_CNT + INDIRECT_CNT + DBL_INDIRECT_CNT)
+
+/* Largest file that is stored inline, in bytes. */
+#define INLINE_MAX (SECTOR_CNT * sizeof (block_sector_t))
+
+/* Number of sector numbers in an index block. */
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Largest possible file, in bytes. */
+#define INODE_SPAN ((DIRECT_CNT                                              \
+                     + PTRS_PER_SECTOR * INDIRECT_CNT                        \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR * DBL_INDIRECT_CNT) \
+                    * BLOCK_SECTOR_SIZE)
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               
-    off_t length;                       
-    unsigned magic;                     
-    uint32_t unused[125];               
+    union
+      {
+        block_sector_t sectors[SECTOR_CNT]; /* Data and index sectors. */
+        uint8_t inline_data[INLINE_MAX];    /* Data, if INODE_INLINE. */
+      };
+    off_t length;                       /* File size in bytes. */
+    unsigned flags;                     /* INODE_* flags. */
+    unsigned magic;                     /* Magic number. */
   };
 
+/* inode_disk flags. */
+#define INODE_INLINE 0x1                /* Data is in inline_data[]. */
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -31,14 +76,218 @@ bytes_to_sectors (off_t size)
 
 struct inode 
   {
-    struct list_elem elem;              
+    struct hash_elem hash_elem;         /* Element in open_inodes. */
+    struct list_elem lru_elem;          /* Element in closed_inodes. */
     block_sector_t sector;              
     int open_cnt;                       
     bool removed;                       
     int deny_write_cnt;                 
+    block_sector_t alloc_hint;          /* Next sector to try to allocate. */
+    struct dir_index *dir_index;        /* Index, if a directory. */
     struct inode_disk data;             
   };
 
+/* Finds where the number of data sector IDX of a file is kept.
+   Stores into *TOP the index into inode_disk's sectors[] at the
+   root of its path and into OFS[] its offset within each index
+   block along the way, and returns the number of index blocks on
+   the path (0, 1, or 2). */
+static int
+locate (size_t idx, size_t *top, size_t ofs[2])
+{
+  if (idx < DIRECT_CNT)
+    {
+      *top = idx;
+      return 0;
+    }
+  idx -= DIRECT_CNT;
+  if (idx < (size_t) PTRS_PER_SECTOR)
+    {
+      *top = DIRECT_CNT;
+      ofs[0] = idx;
+      return 1;
+    }
+  idx -= PTRS_PER_SECTOR;
+  ASSERT (idx < (size_t) (PTRS_PER_SECTOR * PTRS_PER_SECTOR));
+  *top = DIRECT_CNT + INDIRECT_CNT;
+  ofs[0] = idx / PTRS_PER_SECTOR;
+  ofs[1] = idx % PTRS_PER_SECTOR;
+  return 2;
+}
+
+/* Returns the number of data sector IDX of the file whose inode
+   is DISK, or 0 if it has not been allocated. */
+static block_sector_t
+lookup_sector (const struct inode_disk *disk, size_t idx)
+{
+  size_t top, ofs[2];
+  int levels = locate (idx, &top, ofs);
+  block_sector_t sector = disk->sectors[top];
+  int i;
+
+  for (i = 0; i < levels && sector != 0; i++)
+    {
+      struct cache_block *b = cache_lock (sector);
+      sector = ((block_sector_t *) cache_read (b))[ofs[i]];
+      cache_unlock (b);
+    }
+  return sector;
+}
+
+/* Allocates data sector IDX of the file whose inode is DISK, and
+   any index blocks needed to reach it, if they do not already
+   exist.  New sectors are zeroed and allocated as near after
+   *HINT as possible, and *HINT is advanced past each one.  DISK
+   is updated in memory only.  Returns true if successful, false
+   if the disk is full. */
+static bool
+allocate_sector (struct inode_disk *disk, size_t idx, block_sector_t *hint)
+{
+  size_t top, ofs[2];
+  int levels = locate (idx, &top, ofs);
+  block_sector_t *slot = &disk->sectors[top];
+  struct cache_block *parent = NULL;
+  int i;
+
+  /* Walk down the path, holding the lock on the index block that
+     contains SLOT, if any. */
+  for (i = 0; ; i++)
+    {
+      struct cache_block *b = NULL;
+
+      if (*slot == 0)
+        {
+          block_sector_t sector;
+
+          if (!free_map_allocate_near (1, *hint, &sector))
+            {
+              if (parent != NULL)
+                cache_unlock (parent);
+              return false;
+            }
+          *hint = sector + 1;
+          b = cache_lock (sector);
+          cache_zero (b);
+          *slot = sector;
+          if (parent != NULL)
+            cache_dirty (parent);
+        }
+      else if (i < levels)
+        b = cache_lock (*slot);
+
+      if (parent != NULL)
+        cache_unlock (parent);
+      if (i == levels)
+        {
+          if (b != NULL)
+            cache_unlock (b);
+          return true;
+        }
+      parent = b;
+      slot = (block_sector_t *) cache_read (b) + ofs[i];
+    }
+}
+
+/* Releases SECTOR, which is a data sector if LEVEL is 0 or an
+   index block LEVEL levels above the data otherwise, along with
+   every sector it refers to.  Does nothing if SECTOR is 0. */
+static void
+release_tree (block_sector_t sector, int level)
+{
+  if (sector == 0)
+    return;
+  if (level > 0)
+    {
+      off_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          struct cache_block *b = cache_lock (sector);
+          block_sector_t child = ((block_sector_t *) cache_read (b))[i];
+          cache_unlock (b);
+          release_tree (child, level - 1);
+        }
+    }
+  cache_free (sector);
+  free_map_release (sector, 1);
+}
+
+/* Releases all of the data and index sectors of the file whose
+   inode is DISK. */
+static void
+release_sectors (struct inode_disk *disk)
+{
+  size_t i;
+
+  if (disk->flags & INODE_INLINE)
+    return;
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      int level = (i < DIRECT_CNT ? 0
+                   : i < DIRECT_CNT + INDIRECT_CNT ? 1
+                   : 2);
+      release_tree (disk->sectors[i], level);
+      disk->sectors[i] = 0;
+    }
+}
+
+/* Moves the data of inline file DISK into a new data sector,
+   allocated as near after *HINT as possible, making it an
+   ordinary file.  DISK is updated in memory only.  Returns true
+   if successful, false if the disk is full. */
+static bool
+uninline (struct inode_disk *disk, block_sector_t *hint)
+{
+  block_sector_t sector;
+  struct cache_block *b;
+
+  ASSERT (disk->flags & INODE_INLINE);
+  if (!free_map_allocate_near (1, *hint, &sector))
+    return false;
+  *hint = sector + 1;
+  b = cache_lock (sector);
+  memcpy (cache_zero (b), disk->inline_data, disk->length);
+  cache_unlock (b);
+
+  memset (disk->sectors, 0, sizeof disk->sectors);
+  disk->sectors[0] = sector;
+  disk->flags &= ~INODE_INLINE;
+  return true;
+}
+
+/* Allocates the data sectors that a file whose inode is DISK
+   needs to be LENGTH bytes long, and sets its length to LENGTH,
+   or as far toward LENGTH as the free sectors allow.  New
+   sectors are allocated as near after *HINT as possible.  DISK is
+   updated in memory only.  Returns true if the file reached
+   LENGTH. */
+static bool
+extend (struct inode_disk *disk, off_t length, block_sector_t *hint)
+{
+  size_t idx;
+
+  ASSERT (length <= INODE_SPAN);
+  if (disk->flags & INODE_INLINE)
+    {
+      if (length <= (off_t) INLINE_MAX)
+        {
+          disk->length = length;
+          return true;
+        }
+      if (!uninline (disk, hint))
+        return false;
+    }
+  for (idx = bytes_to_sectors (disk->length); idx < bytes_to_sectors (length);
+       idx++)
+    if (!allocate_sector (disk, idx, hint))
+      {
+        disk->length = idx * BLOCK_SECTOR_SIZE;
+        return false;
+      }
+  disk->length = length;
+  return true;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -48,20 +297,85 @@ byte_to_sector (const struct inode *inode, off_t pos)
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return lookup_sector (&inode->data, pos / BLOCK_SECTOR_SIZE);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns the sector after the last data sector of INODE, or
+   after INODE's own sector if it has no data sectors, as the
+   place to start looking for a sector to extend INODE with. */
+static block_sector_t
+initial_hint (const struct inode *inode)
+{
+  off_t length = inode_length (inode);
 
+  if (length == 0 || (inode->data.flags & INODE_INLINE))
+    return inode->sector + 1;
+  return lookup_sector (&inode->data, bytes_to_sectors (length) - 1) + 1;
+}
+
+/* Writes INODE's on-disk inode to the buffer cache. */
+static void
+write_inode (struct inode *inode)
+{
+  struct cache_block *b = cache_lock (inode->sector);
+  memcpy (cache_zero (b), &inode->data, BLOCK_SECTOR_SIZE);
+  cache_unlock (b);
+}
+
+/* In-memory inodes, hashed by sector, so that opening a single
+   inode twice returns the same `struct inode'.
+
+   When the last opener closes an inode, it is kept in memory,
+   on closed_inodes, with its on-disk inode and any directory
+   index, so that reopening it soon after costs neither a sector
+   read nor a rebuilt index.  Up to CLOSED_MAX closed inodes are
+   kept this way; beyond that, the least recently closed is
+   freed. */
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+#define CLOSED_MAX 32
+
+/* Statistics. */
+static unsigned long long lookup_cnt;       /* Calls to inode_open(). */
+static unsigned long long revive_cnt;       /* ...that found it closed. */
+static unsigned long long read_cnt;         /* ...that read it. */
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, hash_elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A's sector precedes B's. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, hash_elem);
+  const struct inode *b = hash_entry (b_, struct inode, hash_elem);
+  return a->sector < b->sector;
+}
 
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("can't create inode table");
+  list_init (&closed_inodes);
+}
+
+/* Frees in-memory INODE, which must be closed. */
+static void
+free_inode (struct inode *inode)
+{
+  hash_delete (&open_inodes, &inode->hash_elem);
+  dir_index_destroy (inode->dir_index);
+  free (inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -81,25 +395,25 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (length > INODE_SPAN)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
+      block_sector_t hint = sector + 1;
+
+      disk_inode->flags = INODE_INLINE;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (extend (disk_inode, length, &hint)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          struct cache_block *b = cache_lock (sector);
+          memcpy (cache_zero (b), disk_inode, BLOCK_SECTOR_SIZE);
+          cache_unlock (b);
           success = true; 
         } 
+      else
+        release_sectors (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,19 +425,25 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
+  struct cache_block *b;
 
-  
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lookup_cnt++;
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, hash_elem);
+      if (inode->open_cnt == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->lru_elem);
+          closed_cnt--;
+          revive_cnt++;
         }
+      inode_reopen (inode);
+      return inode; 
     }
 
   
@@ -132,12 +452,17 @@ inode_open (block_sector_t sector)
     return NULL;
 
   
-  list_push_front (&open_inodes, &inode->elem);
+  read_cnt++;
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->hash_elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->alloc_hint = 0;
+  inode->dir_index = NULL;
+  b = cache_lock (inode->sector);
+  memcpy (&inode->data, cache_read (b), BLOCK_SECTOR_SIZE);
+  cache_unlock (b);
   return inode;
 }
 
@@ -171,17 +496,23 @@ inode_close (struct inode *inode)
   if (--inode->open_cnt == 0)
     {
       
-      list_remove (&inode->elem);
- 
-      
       if (inode->removed) 
         {
+          release_sectors (&inode->data);
+          cache_free (inode->sector);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          free_inode (inode);
+          return;
         }
 
-      free (inode); 
+      /* Keep it for a while, in case it is reopened. */
+      list_push_front (&closed_inodes, &inode->lru_elem);
+      if (++closed_cnt > CLOSED_MAX)
+        {
+          struct list_elem *e = list_pop_back (&closed_inodes);
+          closed_cnt--;
+          free_inode (list_entry (e, struct inode, lru_elem));
+        }
     }
 }
 
@@ -202,7 +533,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (inode->data.flags & INODE_INLINE)
+    {
+      off_t left = inode_length (inode) - offset;
+      if (size > left)
+        size = left;
+      if (size <= 0)
+        return 0;
+      memcpy (buffer, inode->data.inline_data + offset, size);
+      return size;
+    }
 
   while (size > 0) 
     {
@@ -217,53 +558,83 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       
       int chunk_size = size < min_left ? size : min_left;
+      struct cache_block *b;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy the chunk out of the cached sector. */
+      b = cache_lock (sector_idx);
+      memcpy (buffer + bytes_read, (uint8_t *) cache_read (b) + sector_ofs,
+              chunk_size);
+      cache_unlock (b);
       
       
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Asks for the sectors that hold SIZE bytes of INODE starting at
+   OFFSET, or as many of them as lie within the file, to be read
+   into the buffer cache in the background. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset) 
+{
+  off_t end = offset + size;
+
+  if (inode->data.flags & INODE_INLINE)
+    return;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, offset));
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   A write past end of file extends INODE first.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up, the write would pass
+   INODE_SPAN, or an error occurs. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
+  if (inode->deny_write_cnt || offset >= INODE_SPAN)
     return 0;
+  if (size > INODE_SPAN - offset)
+    size = INODE_SPAN - offset;
+
+  if (size > 0 && offset + size > inode_length (inode))
+    {
+      off_t length = offset + size;
+      off_t old_length = inode_length (inode);
+
+      if (inode->alloc_hint == 0)
+        inode->alloc_hint = initial_hint (inode);
+      extend (&inode->data, length, &inode->alloc_hint);
+      if (inode_length (inode) != old_length
+          && !(inode->data.flags & INODE_INLINE))
+        write_inode (inode);
+    }
+
+  if (inode->data.flags & INODE_INLINE)
+    {
+      off_t left = inode_length (inode) - offset;
+      if (size > left)
+        size = left;
+      if (size <= 0)
+        return 0;
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      write_inode (inode);
+      return size;
+    }
 
   while (size > 0) 
     {
@@ -278,41 +649,30 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       
       int chunk_size = size < min_left ? size : min_left;
+      struct cache_block *b;
+      uint8_t *data;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* If the sector contains data before or after the chunk
+         we're writing, then we need to read in the sector
+         first.  Otherwise we start with a sector of all zeros. */
+      b = cache_lock (sector_idx);
+      if (sector_ofs > 0 || chunk_size < sector_left) 
         {
-          
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          data = cache_read (b);
+          cache_dirty (b);
         }
+      else
+        data = cache_zero (b);
+      memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
+      cache_unlock (b);
 
       
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
@@ -343,3 +703,28 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns INODE's directory index, or a null pointer if it has
+   none. */
+struct dir_index *
+inode_get_dir_index (const struct inode *inode)
+{
+  return inode->dir_index;
+}
+
+/* Sets INODE's directory index to INDEX.  INODE takes ownership
+   of INDEX and frees it with dir_index_destroy() when INODE is
+   freed. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index)
+{
+  inode->dir_index = index;
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void)
+{
+  printf ("Inode: %llu opens, %llu of closed inodes, %llu read from disk\n",
+          lookup_cnt, revive_cnt, read_cnt);
+}
@@ -296,15 +296,57 @@ size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
+  return bitmap_scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B that are all set to VALUE and lie
+   entirely at or after START and before END.
+   If there is no such group, returns BITMAP_ERROR.
+   Whole elements in which no bit, or every bit, is set to VALUE
+   are skipped over or counted an element at a time. */
+size_t
+bitmap_scan_range (const struct bitmap *b, size_t start, size_t end,
+                   size_t cnt, bool value) 
+{
+  elem_type none = value ? 0 : (elem_type) -1;
+  size_t run_start = start;
+  size_t i = start;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= end);
+  ASSERT (end <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > end - start)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  while (i < end)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      if (i % ELEM_BITS == 0 && i + ELEM_BITS <= end)
+        {
+          elem_type elem = b->bits[elem_idx (i)];
+          if (elem == none)
+            {
+              i += ELEM_BITS;
+              run_start = i;
+              continue;
+            }
+          else if (elem == ~none)
+            {
+              i += ELEM_BITS;
+              if (i - run_start >= cnt)
+                return run_start;
+              continue;
+            }
+        }
+
+      if (bitmap_test (b, i) != value)
+        run_start = i + 1;
+      else if (i + 1 - run_start >= cnt)
+        return run_start;
+      i++;
     }
   return BITMAP_ERROR;
 }
@@ -358,6 +400,19 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B that start at byte offset OFS to
+   the same offset in FILE, leaving the rest of FILE as the last
+   bitmap_write() left it.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  ASSERT (ofs + size <= byte_cnt (b->bit_cnt));
+  return file_write_at (file, (const uint8_t *) b->bits + ofs, size,
+                        ofs) == (off_t) size;
+}
 #endif 
 
 
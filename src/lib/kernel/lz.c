@@ -0,0 +1,188 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Shortest back-reference worth encoding. */
+#define MIN_MATCH 4
+
+/* Largest back-reference offset. */
+#define MAX_OFFSET 0xffff
+
+/* Each 4-bit length field in a token holds this value when the
+   length continues in extra bytes. */
+#define LEN_MASK 15
+
+/* Returns the 4 bytes at P as a 32-bit value. */
+static inline uint32_t
+read32 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the hash table index for the 4 bytes V. */
+static inline size_t
+hash32 (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the part of length LEN that does not fit in a token's
+   4-bit field, which must be LEN_MASK, to OP.  Returns the
+   position just past it. */
+static uint8_t *
+put_len (uint8_t *op, size_t len)
+{
+  for (len -= LEN_MASK; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* Reads extra length bytes from *IP, which may not pass END, and
+   adds them to *LEN.  Returns false if the input ends first. */
+static bool
+get_len (const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= end)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Writes one sequence to OP, which may not pass END: LIT_LEN
+   literal bytes from LIT, followed unless LAST is true by a
+   back-reference of MATCH_LEN bytes at OFFSET.  Returns the
+   position just past the sequence, or a null pointer if it does
+   not fit. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *end, const uint8_t *lit, size_t lit_len,
+              size_t match_len, size_t offset, bool last)
+{
+  size_t max_size = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+  size_t code = last ? 0 : match_len - MIN_MATCH;
+
+  if (max_size > (size_t) (end - op))
+    return NULL;
+
+  *op++ = ((lit_len < LEN_MASK ? lit_len : LEN_MASK) << 4
+           | (code < LEN_MASK ? code : LEN_MASK));
+  if (lit_len >= LEN_MASK)
+    op = put_len (op, lit_len);
+  memcpy (op, lit, lit_len);
+  op += lit_len;
+
+  if (!last)
+    {
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      if (code >= LEN_MASK)
+        op = put_len (op, code);
+    }
+  return op;
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes
+   at DST, using the LZ_WORK_SIZE bytes at WORK as scratch.
+   Returns the compressed size, or 0 if the result does not fit
+   in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, void *work)
+{
+  const uint8_t *src = src_;
+  const uint8_t *end = src + src_size;
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint16_t *table = work;
+
+  ASSERT (src_size <= MAX_OFFSET + 1);
+
+  memset (table, 0, LZ_WORK_SIZE);
+  while (end - ip >= MIN_MATCH)
+    {
+      uint32_t seq = read32 (ip);
+      size_t h = hash32 (seq);
+      const uint8_t *ref = src + table[h];
+
+      table[h] = ip - src;
+      if (ref < ip && ip - ref <= MAX_OFFSET && read32 (ref) == seq)
+        {
+          size_t len = MIN_MATCH;
+          while (ip + len < end && ref[len] == ip[len])
+            len++;
+
+          op = put_sequence (op, dst + dst_size, anchor, ip - anchor,
+                             len, ip - ref, false);
+          if (op == NULL)
+            return 0;
+          ip += len;
+          anchor = ip;
+        }
+      else
+        ip++;
+    }
+
+  op = put_sequence (op, dst + dst_size, anchor, end - anchor, 0, 0, true);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Decompresses the SRC_SIZE bytes at SRC, produced by
+   lz_compress(), into the DST_SIZE bytes at DST.  Returns true
+   if the data was well-formed and decompressed to exactly
+   DST_SIZE bytes, false otherwise. */
+bool
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *end = ip + src_size;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_size;
+
+  while (ip < end)
+    {
+      uint8_t token = *ip++;
+      size_t lit_len = token >> 4;
+      size_t match_len = token & LEN_MASK;
+      size_t offset;
+
+      /* Literals. */
+      if (lit_len == LEN_MASK && !get_len (&ip, end, &lit_len))
+        return false;
+      if (lit_len > (size_t) (end - ip) || lit_len > (size_t) (op_end - op))
+        return false;
+      memcpy (op, ip, lit_len);
+      ip += lit_len;
+      op += lit_len;
+      if (ip == end)
+        break;
+
+      /* Back-reference, which may overlap the bytes it
+         produces. */
+      if (end - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (match_len == LEN_MASK && !get_len (&ip, end, &match_len))
+        return false;
+      match_len += MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || match_len > (size_t) (op_end - op))
+        return false;
+      for (; match_len > 0; match_len--, op++)
+        *op = op[-offset];
+    }
+  return op == op_end;
+}
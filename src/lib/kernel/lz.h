@@ -0,0 +1,33 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77-family compressor.
+
+   A small, fast byte-oriented compressor in the style of LZ4,
+   meant for compressing memory pages rather than for a good
+   compression ratio.  The compressed stream is a series of
+   sequences, each a token byte followed by a run of literal
+   bytes and then a back-reference (a 16-bit offset and a
+   length) into the data already produced.  The final sequence
+   has literals only.
+
+   lz_compress() needs LZ_WORK_SIZE bytes of scratch memory for
+   its hash table, which the caller supplies so that compressing
+   does not allocate memory and so that the caller can decide
+   how to share one work area among threads.  Inputs may be at
+   most 64 kB long. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes of scratch memory needed by lz_compress(). */
+#define LZ_HASH_BITS 12
+#define LZ_WORK_SIZE (sizeof (uint16_t) << LZ_HASH_BITS)
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, void *work);
+bool lz_decompress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stddef.h>
+
+/* Memory use of a process, as returned by the memstat() system
+   call.  Sizes are in pages.  The resident and working set sizes
+   are sampled periodically, so they lag slightly behind. */
+struct memstat
+  {
+    size_t resident;            /* Pages in memory. */
+    size_t working_set;         /* Pages used in the last second. */
+    size_t resident_limit;      /* Soft limit on resident pages. */
+    size_t evicted;             /* Pages evicted so far. */
+  };
+
+/* resident_limit of a process without a limit. */
+#define MEMSTAT_NO_LIMIT ((size_t) -1)
+
+/* Process ID that stands for the calling process. */
+#define MEMSTAT_SELF 0
+
+#endif
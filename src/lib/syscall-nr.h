@@ -28,7 +28,17 @@ enum
     SYS_MKDIR,                  
     SYS_READDIR,                
     SYS_ISDIR,                  
-    SYS_INUMBER                 
+    SYS_INUMBER,                
+
+    /* Copy-on-write process creation. */
+    SYS_FORK,                   /* Clone the current process. */
+
+    /* Memory use. */
+    SYS_MEMSTAT,                /* Get a process's memory use. */
+    SYS_MEMLIMIT,               /* Set a process's resident set limit. */
+
+    /* Scheduling. */
+    SYS_YIELD                   /* Give up the CPU. */
   };
 
 #endif 
@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+memstat (pid_t pid, struct memstat *m)
+{
+  return syscall2 (SYS_MEMSTAT, pid, m);
+}
+
+bool
+memlimit (pid_t pid, size_t pages)
+{
+  return syscall2 (SYS_MEMLIMIT, pid, pages);
+}
+
+void
+yield (void)
+{
+  syscall0 (SYS_YIELD);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <memstat.h>
 
 
 typedef int pid_t;
@@ -45,4 +46,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+
+pid_t fork (void);
+
+
+bool memstat (pid_t, struct memstat *);
+bool memlimit (pid_t, size_t pages);
+
+
+void yield (void);
+
 #endif 
@@ -0,0 +1,348 @@
+#include "threads/heap-prof.h"
+#ifdef HEAP_PROFILE
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Heap profiler.
+
+   Two open-addressed hash tables with linear probing, both
+   carved out of the kernel pool at startup so that recording an
+   allocation never allocates memory itself:
+
+   - The site table, keyed by (caller, kind), accumulates
+     per-call-site counters.
+
+   - The live table, keyed by block address, remembers the site,
+     size and allocation time of every block that has not yet
+     been freed, so that frees can be charged back to the right
+     site and leaks can be listed at shutdown.
+
+   Both tables are protected by disabling interrupts, because
+   palloc_free_page() is called with interrupts off when a dying
+   thread's stack is released. */
+
+/* Per-call-site counters. */
+struct site
+  {
+    const void *caller;         /* Return address of the caller. */
+    enum heap_prof_kind kind;   /* Allocator used. */
+    size_t live_bytes;          /* Bytes currently allocated. */
+    size_t peak_bytes;          /* Maximum value of live_bytes. */
+    unsigned live_cnt;          /* Blocks currently allocated. */
+    unsigned alloc_cnt;         /* Total number of allocations. */
+  };
+
+/* A block that has been allocated but not yet freed. */
+struct live
+  {
+    const void *block;          /* Block address, null if slot empty. */
+    size_t size;                /* Size in bytes. */
+    uint32_t when;              /* Timer tick of the allocation. */
+    uint16_t site_idx;          /* Index into sites[]. */
+  };
+
+#define SITE_PAGES 4
+#define SITE_CNT (SITE_PAGES * PGSIZE / sizeof (struct site))
+#define LIVE_PAGES 32
+#define LIVE_CNT (LIVE_PAGES * PGSIZE / sizeof (struct live))
+
+/* Maximum number of unfreed allocations listed at shutdown. */
+#define LEAK_REPORT_MAX 16
+
+static struct site *sites;
+static struct live *lives;
+static size_t site_cnt;
+static size_t live_cnt;
+
+/* Totals over all sites, by kind. */
+static size_t total_live_bytes[2];
+static size_t total_peak_bytes[2];
+
+/* Events we could not record because a table was full. */
+static unsigned long long dropped_cnt;
+
+static size_t hash_ptr (const void *);
+static struct site *find_site (enum heap_prof_kind, const void *caller);
+static struct live *find_live (const void *);
+static void remove_live (struct live *);
+static bool site_before (const struct site *, const struct site *);
+static bool live_before (const struct live *, const struct live *);
+static void charge (struct site *, enum heap_prof_kind, size_t old_size,
+                    size_t new_size);
+
+/* Allocates the profiler's tables.  Must be called after
+   palloc_init() and before any allocation that should be
+   profiled. */
+void
+heap_prof_init (void)
+{
+  sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, SITE_PAGES);
+  lives = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, LIVE_PAGES);
+}
+
+/* Records that CALLER obtained SIZE bytes at BLOCK from the
+   allocator of the given KIND. */
+void
+heap_prof_alloc (enum heap_prof_kind kind, const void *caller,
+                 const void *block, size_t size)
+{
+  enum intr_level old_level;
+  struct site *s;
+  struct live *l;
+
+  if (sites == NULL || block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = find_site (kind, caller);
+  l = find_live (block);
+  if (s != NULL && l != NULL && live_cnt < LIVE_CNT - 1)
+    {
+      ASSERT (l->block == NULL);
+      l->block = block;
+      l->size = size;
+      l->when = timer_ticks ();
+      l->site_idx = s - sites;
+      live_cnt++;
+
+      s->live_cnt++;
+      s->alloc_cnt++;
+      charge (s, kind, 0, size);
+    }
+  else
+    dropped_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK was resized in place to NEW_SIZE bytes. */
+void
+heap_prof_resize (const void *block, size_t new_size)
+{
+  enum intr_level old_level;
+  struct live *l;
+
+  if (sites == NULL)
+    return;
+
+  old_level = intr_disable ();
+  l = find_live (block);
+  if (l != NULL && l->block != NULL)
+    {
+      struct site *s = &sites[l->site_idx];
+      charge (s, s->kind, l->size, new_size);
+      l->size = new_size;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK was freed.  Blocks allocated before the
+   profiler was initialized, or dropped because a table was full,
+   are silently ignored. */
+void
+heap_prof_free (const void *block)
+{
+  enum intr_level old_level;
+  struct live *l;
+
+  if (sites == NULL || block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  l = find_live (block);
+  if (l != NULL && l->block != NULL)
+    {
+      struct site *s = &sites[l->site_idx];
+      charge (s, s->kind, l->size, 0);
+      s->live_cnt--;
+      remove_live (l);
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints per-site heap usage, largest live usage first, followed
+   by the oldest allocations that were never freed. */
+void
+heap_prof_print_stats (void)
+{
+  static const char *kind_names[] = {"malloc", "palloc"};
+  enum intr_level old_level;
+  struct site *prev_site = NULL;
+  struct live *prev_live = NULL;
+  size_t printed;
+
+  if (sites == NULL)
+    return;
+
+  old_level = intr_disable ();
+  printf ("Heap: %zu live malloc bytes (peak %zu), "
+          "%zu live palloc bytes (peak %zu), %zu sites, %llu dropped\n",
+          total_live_bytes[HEAP_PROF_MALLOC],
+          total_peak_bytes[HEAP_PROF_MALLOC],
+          total_live_bytes[HEAP_PROF_PALLOC],
+          total_peak_bytes[HEAP_PROF_PALLOC],
+          site_cnt, dropped_cnt);
+
+  /* Each pass picks the next site in order of decreasing live
+     bytes, which is quadratic but fine for a report printed
+     once. */
+  printf ("  %-10s %-6s %10s %6s %10s %8s\n",
+          "site", "kind", "live-bytes", "live", "peak-bytes", "allocs");
+  for (printed = 0; printed < site_cnt; printed++)
+    {
+      struct site *best = NULL;
+      struct site *s;
+
+      for (s = sites; s < sites + SITE_CNT; s++)
+        if (s->caller != NULL
+            && (prev_site == NULL || site_before (prev_site, s))
+            && (best == NULL || site_before (s, best)))
+          best = s;
+      if (best == NULL)
+        break;
+      printf ("  %10p %-6s %10zu %6u %10zu %8u\n",
+              best->caller, kind_names[best->kind], best->live_bytes,
+              best->live_cnt, best->peak_bytes, best->alloc_cnt);
+      prev_site = best;
+    }
+
+  /* Same again for the oldest blocks that are still allocated. */
+  printf ("Heap: %zu allocations never freed", live_cnt);
+  if (live_cnt > LEAK_REPORT_MAX)
+    printf (", oldest %d shown", LEAK_REPORT_MAX);
+  printf (":\n");
+  for (printed = 0; printed < live_cnt && printed < LEAK_REPORT_MAX;
+       printed++)
+    {
+      struct live *oldest = NULL;
+      struct live *l;
+
+      for (l = lives; l < lives + LIVE_CNT; l++)
+        if (l->block != NULL
+            && (prev_live == NULL || live_before (prev_live, l))
+            && (oldest == NULL || live_before (l, oldest)))
+          oldest = l;
+      if (oldest == NULL)
+        break;
+      printf ("  %10p %8zu bytes at tick %"PRIu32" from %p\n",
+              oldest->block, oldest->size, oldest->when,
+              sites[oldest->site_idx].caller);
+      prev_live = oldest;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if site A is reported before site B: more live
+   bytes first, ties broken by table position. */
+static bool
+site_before (const struct site *a, const struct site *b)
+{
+  if (a->live_bytes != b->live_bytes)
+    return a->live_bytes > b->live_bytes;
+  return a < b;
+}
+
+/* Returns true if live block A is reported before live block B:
+   older first, ties broken by table position. */
+static bool
+live_before (const struct live *a, const struct live *b)
+{
+  if (a->when != b->when)
+    return a->when < b->when;
+  return a < b;
+}
+
+/* Returns a hash of pointer P. */
+static size_t
+hash_ptr (const void *p)
+{
+  return ((uintptr_t) p >> 4) * 2654435761u;
+}
+
+/* Returns the site for (KIND, CALLER), creating it if necessary.
+   Returns a null pointer if the site table is full. */
+static struct site *
+find_site (enum heap_prof_kind kind, const void *caller)
+{
+  size_t i = hash_ptr (caller) % SITE_CNT;
+
+  for (;;)
+    {
+      struct site *s = &sites[i];
+      if (s->caller == NULL)
+        {
+          if (site_cnt >= SITE_CNT - 1)
+            return NULL;
+          s->caller = caller;
+          s->kind = kind;
+          site_cnt++;
+          return s;
+        }
+      if (s->caller == caller && s->kind == kind)
+        return s;
+      i = (i + 1) % SITE_CNT;
+    }
+}
+
+/* Returns the live-table slot that holds BLOCK, or the empty
+   slot where it would be inserted. */
+static struct live *
+find_live (const void *block)
+{
+  size_t i = hash_ptr (block) % LIVE_CNT;
+
+  while (lives[i].block != NULL && lives[i].block != block)
+    i = (i + 1) % LIVE_CNT;
+  return &lives[i];
+}
+
+/* Empties slot L, shifting later members of its probe sequence
+   back so that lookups never stop at a hole. */
+static void
+remove_live (struct live *l)
+{
+  size_t hole = l - lives;
+  size_t i = hole;
+
+  for (;;)
+    {
+      size_t home;
+
+      i = (i + 1) % LIVE_CNT;
+      if (lives[i].block == NULL)
+        break;
+
+      /* Move entry I into the hole unless its home slot lies
+         cyclically in (HOLE, I]. */
+      home = hash_ptr (lives[i].block) % LIVE_CNT;
+      if (hole <= i ? (home <= hole || home > i) : (home <= hole && home > i))
+        {
+          lives[hole] = lives[i];
+          hole = i;
+        }
+    }
+  lives[hole].block = NULL;
+  live_cnt--;
+}
+
+/* Adjusts site S and the totals for KIND when a block changes
+   from OLD_SIZE to NEW_SIZE bytes. */
+static void
+charge (struct site *s, enum heap_prof_kind kind, size_t old_size,
+        size_t new_size)
+{
+  s->live_bytes += new_size - old_size;
+  if (s->live_bytes > s->peak_bytes)
+    s->peak_bytes = s->live_bytes;
+
+  total_live_bytes[kind] += new_size - old_size;
+  if (total_live_bytes[kind] > total_peak_bytes[kind])
+    total_peak_bytes[kind] = total_live_bytes[kind];
+}
+#endif
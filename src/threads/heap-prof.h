@@ -0,0 +1,45 @@
+#ifndef THREADS_HEAP_PROF_H
+#define THREADS_HEAP_PROF_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* Kernel heap profiling.
+
+   When the kernel is built with HEAP_PROFILE defined (add
+   "kernel.bin: DEFINES += -DHEAP_PROFILE" to a Make.vars), every
+   malloc() and palloc_get_*() call is charged to its call site,
+   identified by the caller's return address, and a report of
+   live bytes, peak usage, and allocations never freed is printed
+   at shutdown.  Use the "backtrace" utility on kernel.o to turn
+   the site addresses into function names.
+
+   Without HEAP_PROFILE, all of the hooks below are empty inline
+   functions that the compiler removes entirely. */
+
+/* Allocator that produced an allocation. */
+enum heap_prof_kind
+  {
+    HEAP_PROF_MALLOC,           /* malloc(), calloc(), realloc(). */
+    HEAP_PROF_PALLOC            /* palloc_get_page/multiple(). */
+  };
+
+#ifdef HEAP_PROFILE
+void heap_prof_init (void);
+void heap_prof_alloc (enum heap_prof_kind, const void *caller,
+                      const void *, size_t size);
+void heap_prof_resize (const void *, size_t new_size);
+void heap_prof_free (const void *);
+void heap_prof_print_stats (void);
+#else
+static inline void heap_prof_init (void) {}
+static inline void
+heap_prof_alloc (enum heap_prof_kind kind UNUSED, const void *caller UNUSED,
+                 const void *p UNUSED, size_t size UNUSED) {}
+static inline void heap_prof_resize (const void *p UNUSED,
+                                     size_t new_size UNUSED) {}
+static inline void heap_prof_free (const void *p UNUSED) {}
+static inline void heap_prof_print_stats (void) {}
+#endif
+
+#endif
@@ -15,6 +15,7 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/heap-prof.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -26,14 +27,24 @@
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#include "vm/workset.h"
+#include "vm/zswap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -59,6 +70,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_feature (uint32_t features);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -96,8 +108,15 @@ main (void)
 
   
   palloc_init (user_page_limit);
+  heap_prof_init ();
   malloc_init ();
   paging_init ();
+#ifdef USERPROG
+  pagedir_init ();
+#endif
+#ifdef VM
+  frame_init ();
+#endif
 
   
 #ifdef USERPROG
@@ -126,6 +145,11 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+  prefetch_init ();
+  workset_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -150,16 +174,41 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CPUID leaf 1 feature bits in EDX.  See [IA32-v2a] "CPUID". */
+#define CPUID_PSE (1 << 3)      /* 4 MB pages. */
+#define CPUID_PGE (1 << 13)     /* Global pages. */
+
+/* CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010      /* Page size extensions. */
+#define CR4_PGE 0x00000080      /* Page global enable. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each fully populated 4 MB region of
+   RAM is mapped with a single large PDE, which saves a page
+   table per 4 MB and many TLB entries.  The region containing
+   the kernel text keeps 4 kB pages, so that the text can stay
+   read-only, as does a partial region at the end of RAM.
+
+   The kernel mapping is identical in every page directory, so
+   if the CPU supports global pages we mark it global.  Loading
+   CR3 on a process switch then flushes only user translations
+   from the TLB. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool use_pse = cpu_has_feature (CPUID_PSE);
+  uint32_t global = cpu_has_feature (CPUID_PGE) ? PTE_G : 0;
+
+  if (use_pse)
+    asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                  : : "i" (CR4_PSE) : "eax");
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -171,13 +220,22 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (use_pse && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -186,6 +244,23 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Enable global pages only now, so that no translation from the
+     loader's temporary page tables survives the switch above. */
+  if (global)
+    asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                  : : "i" (CR4_PGE) : "eax", "memory");
+}
+
+/* Returns true if the CPU reports every feature in FEATURES, a
+   set of CPUID_* bits from leaf 1's EDX. */
+static bool
+cpu_has_feature (uint32_t features)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & features) == features;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -243,6 +318,8 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-da"))
+        cache_dirty_ms = atoi (value);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -259,6 +336,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
+      else if (!strcmp (name, "-fa"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-zs"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-rl"))
+        rss_limit_default = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -373,6 +460,7 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -da=MS             Write back cached sectors dirty for MS ms.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -381,6 +469,12 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
+          "  -fa=COUNT          Map up to COUNT pages around each page fault.\n"
+          "  -zs=COUNT          Keep up to COUNT pages of compressed swap in RAM.\n"
+          "  -rl=COUNT          Limit each process's resident set to COUNT pages.\n"
 #endif
           );
   shutdown_power_off ();
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heap-prof.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -66,6 +67,9 @@ static size_t desc_cnt;
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *alloc_block (size_t);
+static void free_block (void *);
+static bool resize_in_place (void *, size_t new_size);
 
 
 void
@@ -88,6 +92,37 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc_block (size);
+  heap_prof_alloc (HEAP_PROF_MALLOC, __builtin_return_address (0), p, size);
+  return p;
+}
+
+/* Allocates A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  
+  p = alloc_block (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  heap_prof_alloc (HEAP_PROF_MALLOC, __builtin_return_address (0), p, size);
+
+  return p;
+}
+
+/* Does the work of malloc(), without profiling. */
+static void *
+alloc_block (size_t size) 
 {
   struct desc *d;
   struct block *b;
@@ -107,7 +142,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_unprofiled (0, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -127,7 +162,7 @@ malloc (size_t size)
       size_t i;
 
       
-      a = palloc_get_page (0);
+      a = palloc_get_unprofiled (0, 1);
       if (a == NULL) 
         {
           lock_release (&d->lock);
@@ -153,27 +188,6 @@ malloc (size_t size)
   return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
-   Returns a null pointer if memory is not available. */
-void *
-calloc (size_t a, size_t b) 
-{
-  void *p;
-  size_t size;
-
-  
-  size = a * b;
-  if (size < a || size < b)
-    return NULL;
-
-  
-  p = malloc (size);
-  if (p != NULL)
-    memset (p, 0, size);
-
-  return p;
-}
-
 
 static size_t
 block_size (void *block) 
@@ -190,7 +204,11 @@ block_size (void *block)
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+   The block is resized in place, without copying, if NEW_SIZE
+   still fits in its descriptor's block size, or if it is a big
+   block whose page run can be shrunk or extended into the
+   adjacent free pages. */
 void *
 realloc (void *old_block, size_t new_size) 
 {
@@ -199,24 +217,63 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    {
+      heap_prof_resize (old_block, new_size);
+      return old_block;
+    }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc_block (new_size);
+      heap_prof_alloc (HEAP_PROF_MALLOC, __builtin_return_address (0),
+                       new_block, new_size);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
-          free (old_block);
+          heap_prof_free (old_block);
+          free_block (old_block);
         }
       return new_block;
     }
 }
 
+/* Tries to make BLOCK hold at least NEW_SIZE bytes without
+   moving it.  Returns true if successful, false if the caller
+   must fall back to copying. */
+static bool
+resize_in_place (void *block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (block);
+  size_t old_cnt, new_cnt;
+
+  if (a->desc != NULL)
+    return new_size <= a->desc->block_size;
+
+  /* Big block: adjust the page run in place. */
+  old_cnt = a->free_cnt;
+  new_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (new_cnt <= old_cnt)
+    palloc_shrink_multiple (a, old_cnt, new_cnt);
+  else if (!palloc_extend_multiple (a, old_cnt, new_cnt))
+    return false;
+  a->free_cnt = new_cnt;
+  return true;
+}
+
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) 
+{
+  heap_prof_free (p);
+  free_block (p);
+}
+
+/* Does the work of free(), without profiling. */
+static void
+free_block (void *p) 
 {
   if (p != NULL)
     {
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heap-prof.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -69,6 +70,34 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = palloc_get_unprofiled (flags, page_cnt);
+  heap_prof_alloc (HEAP_PROF_PALLOC, __builtin_return_address (0),
+                   pages, page_cnt * PGSIZE);
+  return pages;
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  void *page = palloc_get_unprofiled (flags, 1);
+  heap_prof_alloc (HEAP_PROF_PALLOC, __builtin_return_address (0),
+                   page, PGSIZE);
+  return page;
+}
+
+/* Does the work of palloc_get_multiple(), without profiling.
+   malloc() takes its arenas from here, since it charges the
+   blocks it carves from them to its own callers. */
+void *
+palloc_get_unprofiled (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
@@ -100,18 +129,6 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
 
 
 void
@@ -132,6 +149,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  heap_prof_free (pages);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
@@ -148,6 +166,63 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Attempts to grow the run of OLD_CNT contiguous pages starting
+   at PAGES, which must have been obtained with
+   palloc_get_multiple(), to NEW_CNT pages without moving it.
+   Succeeds only if the NEW_CNT - OLD_CNT pages that immediately
+   follow the run are free in the same pool.  Returns true if
+   successful, false if the run is left unchanged. */
+bool
+palloc_extend_multiple (void *pages, size_t old_cnt, size_t new_cnt)
+{
+  struct pool *pool;
+  size_t page_idx, extra_cnt;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= old_cnt);
+  if (new_cnt == old_cnt)
+    return true;
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base) + old_cnt;
+  extra_cnt = new_cnt - old_cnt;
+
+  lock_acquire (&pool->lock);
+  if (page_idx + extra_cnt <= bitmap_size (pool->used_map)
+      && bitmap_none (pool->used_map, page_idx, extra_cnt))
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, extra_cnt, true);
+      success = true;
+    }
+  lock_release (&pool->lock);
+
+  if (success)
+    heap_prof_resize (pages, new_cnt * PGSIZE);
+
+  return success;
+}
+
+/* Shrinks the run of OLD_CNT contiguous pages starting at PAGES
+   to its first NEW_CNT pages, returning the tail to the pool. */
+void
+palloc_shrink_multiple (void *pages, size_t old_cnt, size_t new_cnt)
+{
+  ASSERT (new_cnt <= old_cnt);
+  if (new_cnt < old_cnt)
+    {
+      palloc_free_multiple ((uint8_t *) pages + new_cnt * PGSIZE,
+                            old_cnt - new_cnt);
+      heap_prof_resize (pages, new_cnt * PGSIZE);
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
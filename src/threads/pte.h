@@ -66,6 +66,8 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               
 #define PTE_A 0x20              
 #define PTE_D 0x40              
+#define PTE_PS 0x80             /* 1=4 MB page (PDE only, needs CR4.PSE). */
+#define PTE_G 0x100             /* 1=global, kept in TLB across CR3 loads. */
 
 
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -74,12 +76,23 @@ static inline uint32_t pde_create (uint32_t *pt) {
 }
 
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not a 4 MB page, points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB region starting at PAGE
+   directly, without a page table.  PAGE must be 4 MB aligned.
+   The region is readable, and writable as well if WRITABLE is
+   true.  It will be usable only by ring 0 code (the kernel).
+   The CPU honors such PDEs only once CR4.PSE is set. */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & (PTSPAN - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
@@ -92,9 +105,11 @@ static inline uint32_t pte_create_kernel (void *page, bool writable) {
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
-   The page will be usable by both user and kernel code. */
+   The page will be usable by both user and kernel code.
+   User PTEs are never global, because their translations must
+   be flushed when another process's page directory is loaded. */
 static inline uint32_t pte_create_user (void *page, bool writable) {
-  return pte_create_kernel (page, writable) | PTE_U;
+  return (pte_create_kernel (page, writable) & ~PTE_G) | PTE_U;
 }
 
 /* Returns a pointer to the page that page table entry PTE points
@@ -15,6 +15,9 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include "vm/workset.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -185,6 +188,10 @@ tid_t thread_create(const char *name, int priority,
 
   
   t->blocked_ticks = 0;
+#ifdef VM
+  /* Processes inherit their creator's resident set limit. */
+  t->rss_limit = thread_current()->rss_limit;
+#endif
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack'
@@ -502,6 +509,17 @@ init_thread(struct thread *t, const char *name, int priority)
   t->nice = 0;
   t->recent_cpu = ConstFixedPoint(0);
 
+#ifdef USERPROG
+  t->exit_code = -1;
+  list_init(&t->children);
+  list_init(&t->fds);
+  t->next_handle = 2;
+#endif
+#ifdef VM
+  list_init(&t->mappings);
+  t->rss_limit = rss_limit_default;
+#endif
+
   list_insert_ordered(&all_list, &t->allelem, (list_less_func *)&piriorityCompare, NULL);
 }
 
@@ -109,6 +109,25 @@ struct thread
 #ifdef USERPROG
     
     uint32_t *pagedir;                  
+    int exit_code;                      /* Exit code. */
+    struct wait_status *wait_status;    /* This process's completion. */
+    struct list children;               /* Completion of children. */
+    struct list fds;                    /* Open files. */
+    int next_handle;                    /* Next file or mapping handle. */
+#endif
+#ifdef VM
+    struct list mappings;               /* Memory-mapped files. */
+    struct hash *pages;                 /* Supplemental page table. */
+    struct file *exec_file;             /* Executable, for paging in. */
+    void *user_esp;                     /* User %esp at last kernel entry. */
+    void *last_fault;                   /* Page of last page fault. */
+
+    /* Resident and working set sizes, in pages (see workset.c). */
+    size_t rss;                         /* Resident pages. */
+    size_t wss;                         /* Working set pages. */
+    size_t rss_limit;                   /* Soft limit on rss. */
+    size_t rss_next, wss_next;          /* Counts for next sample. */
+    size_t evict_cnt;                   /* Pages evicted. */
 #endif
 
     
@@ -4,6 +4,10 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 
 static long long page_fault_cnt;
@@ -148,9 +152,35 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* A fault on a page that is not present may just mean that the
+     page has not been read in yet, or that the stack needs to
+     grow.  This also covers the kernel touching user memory on a
+     process's behalf, in which case the user stack pointer was
+     saved on entry to the system call. */
+  if (user)
+    thread_current ()->user_esp = f->esp;
+  if (not_present && is_user_vaddr (fault_addr) && page_in (fault_addr))
+    return;
+
+  /* A write to a present page that is mapped read-only may be to
+     a page shared copy-on-write after fork(). */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_copy_on_write (fault_addr))
+    return;
+#endif
+
+  /* A bad user address touched by the kernel can only come from
+     get_user() or put_user() in syscall.c, which leave the
+     address to resume at in %eax.  Resume there, with %eax
+     zeroed to report the failure. */
+  if (!user && is_user_vaddr (fault_addr)) 
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0;
+      return;
+    }
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
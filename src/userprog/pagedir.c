@@ -5,20 +5,75 @@
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
 
+/* Caches of zeroed pages for recycling page directories and page
+   tables.  Exec-heavy workloads create and destroy address
+   spaces constantly, so instead of returning these pages to the
+   page allocator and zeroing them again on the next allocation,
+   pagedir_destroy() clears just the entries that were in use and
+   keeps the page for reuse.
+
+   A cached page directory keeps its kernel half, which is the
+   same in every page directory, so reusing it needs no copy at
+   all.  The first word of each cached page links to the next. */
+struct page_cache
+  {
+    struct lock lock;
+    void *head;                 /* First cached page, or null. */
+    size_t cnt;                 /* Number of cached pages. */
+    size_t max_cnt;             /* Cache no more than this many. */
+  };
+
+static struct page_cache pd_cache, pt_cache;
+
+#define PD_CACHE_MAX 8
+#define PT_CACHE_MAX 64
+
+/* Range of kernel PDEs that are populated in init_page_dir.
+   PDEs outside this range are zero. */
+static size_t kernel_pde_start, kernel_pde_end;
+
+static void page_cache_init (struct page_cache *, size_t max_cnt);
+static void *page_cache_get (struct page_cache *);
+static bool page_cache_put (struct page_cache *, void *);
+
+/* Initializes the page directory module.  Must be called after
+   paging_init(). */
+void
+pagedir_init (void) 
+{
+  size_t i;
+
+  page_cache_init (&pd_cache, PD_CACHE_MAX);
+  page_cache_init (&pt_cache, PT_CACHE_MAX);
+
+  kernel_pde_start = kernel_pde_end = pd_no (PHYS_BASE);
+  for (i = pd_no (PHYS_BASE); i < PGSIZE / sizeof *init_page_dir; i++)
+    if (init_page_dir[i] != 0)
+      kernel_pde_end = i + 1;
+}
+
 /* Creates a new page directory that has mappings for kernel
-   virtual addresses, but none for user virtual addresses.
+   virtual addresses, but none for user virtual addresses.  The
+   kernel PDEs, including any 4 MB pages set up by paging_init(),
+   are shared with init_page_dir.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
-  if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+  uint32_t *pd = page_cache_get (&pd_cache);
+  if (pd == NULL)
+    {
+      pd = palloc_get_page (PAL_ZERO);
+      if (pd != NULL)
+        memcpy (pd + kernel_pde_start, init_page_dir + kernel_pde_start,
+                (kernel_pde_end - kernel_pde_start) * sizeof *pd);
+    }
   return pd;
 }
 
@@ -34,17 +89,27 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (*pde != 0)
       {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+        if ((*pde & PTE_P) && !(*pde & PTE_PS)) 
+          {
+            uint32_t *pt = pde_get_pt (*pde);
+            uint32_t *pte;
+
+            for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+              if (*pte != 0) 
+                {
+                  if (*pte & PTE_P) 
+                    palloc_free_page (pte_get_page (*pte));
+                  *pte = 0;
+                }
+            if (!page_cache_put (&pt_cache, pt))
+              palloc_free_page (pt);
+          }
+        *pde = 0;
       }
-  palloc_free_page (pd);
+  if (!page_cache_put (&pd_cache, pd))
+    palloc_free_page (pd);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -66,11 +131,19 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (*pde & PTE_PS)
+    {
+      /* A 4 MB kernel page has no page table, hence no PTE. */
+      ASSERT (!create);
+      return NULL;
+    }
   if (*pde == 0) 
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = page_cache_get (&pt_cache);
+          if (pt == NULL)
+            pt = palloc_get_page (PAL_ZERO);
           if (pt == NULL) 
             return NULL; 
       
@@ -256,8 +329,64 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
+      /* Re-activating PD clears the TLB, except for global
+         kernel translations, which never change.  See [IA32-v3a]
+         3.12 "Translation Lookaside Buffers (TLBs)". */
       pagedir_activate (pd);
     } 
 }
+
+/* Initializes cache C to hold at most MAX_CNT pages. */
+static void
+page_cache_init (struct page_cache *c, size_t max_cnt) 
+{
+  lock_init (&c->lock);
+  c->head = NULL;
+  c->cnt = 0;
+  c->max_cnt = max_cnt;
+}
+
+/* Removes and returns a page from cache C, or returns a null
+   pointer if C is empty.  The returned page has the contents it
+   had when it was put into C. */
+static void *
+page_cache_get (struct page_cache *c) 
+{
+  void **page;
+
+  lock_acquire (&c->lock);
+  page = c->head;
+  if (page != NULL)
+    {
+      c->head = *page;
+      c->cnt--;
+      *page = NULL;
+    }
+  lock_release (&c->lock);
+
+  return page;
+}
+
+/* Adds PAGE, whose first word must be zero, to cache C.
+   Returns false if C is full, in which case the caller should
+   free PAGE instead. */
+static bool
+page_cache_put (struct page_cache *c, void *page_) 
+{
+  void **page = page_;
+  bool success = false;
+
+  ASSERT (*page == NULL);
+
+  lock_acquire (&c->lock);
+  if (c->cnt < c->max_cnt)
+    {
+      *page = c->head;
+      c->head = page;
+      c->cnt++;
+      success = true;
+    }
+  lock_release (&c->lock);
+
+  return success;
+}
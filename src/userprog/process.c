@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -14,66 +15,178 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool load (const char *file_name, void (**eip) (void));
+static bool setup_stack (const char *cmd_line, void **esp);
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Tracks the completion of a process.
+   Reference held by both the parent, in its `children' list,
+   and by the child, in its `wait_status' pointer. */
+struct wait_status
+  {
+    struct list_elem elem;              /* `children' list element. */
+    struct lock lock;                   /* Protects ref_cnt. */
+    int ref_cnt;                        /* 2=child and parent both alive,
+                                           1=either child or parent alive,
+                                           0=child and parent both dead. */
+    tid_t tid;                          /* Child thread id. */
+    int exit_code;                      /* Child exit code, if dead. */
+    struct semaphore dead;              /* 1=child alive, 0=child dead. */
+  };
+
+/* Data structure shared between process_execute() in the
+   invoking thread and start_process() in the newly invoked
+   thread. */
+struct exec_info 
+  {
+    const char *cmd_line;               /* Program name and arguments. */
+    struct semaphore load_done;         /* "Up"ed when loading complete. */
+    struct wait_status *wait_status;    /* Child process. */
+    bool success;                       /* Program successfully loaded? */
+  };
+
+static void release_child (struct wait_status *);
+
+/* Starts a new thread running a user program loaded from the
+   first word of CMD_LINE, passing it the words of CMD_LINE as
+   its arguments.  Waits for the program to be loaded.  Returns
+   the new process's thread id, or TID_ERROR if the thread cannot
+   be created or the program cannot be loaded. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmd_line) 
 {
-  char *fn_copy;
+  struct exec_info exec;
+  char thread_name[16];
+  char *save_ptr;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  exec.cmd_line = cmd_line;
+  sema_init (&exec.load_done, 0);
+
+  /* Name the thread after the program. */
+  strlcpy (thread_name, cmd_line, sizeof thread_name);
+  strtok_r (thread_name, " ", &save_ptr);
+
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, &exec);
+  if (tid != TID_ERROR)
+    {
+      sema_down (&exec.load_done);
+      if (exec.success)
+        list_push_back (&thread_current ()->children, &exec.wait_status->elem);
+      else 
+        {
+          if (exec.wait_status != NULL)
+            release_child (exec.wait_status);
+          tid = TID_ERROR;
+        }
+    }
 
-  
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
-  if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
   return tid;
 }
 
+/* Sets up the current thread's wait_status, shared with its
+   parent.
+   Returns the new wait_status, or a null pointer if memory
+   allocation failed. */
+static struct wait_status *
+create_wait_status (void) 
+{
+  struct thread *t = thread_current ();
+
+  t->wait_status = malloc (sizeof *t->wait_status);
+  if (t->wait_status != NULL) 
+    {
+      lock_init (&t->wait_status->lock);
+      t->wait_status->ref_cnt = 2;
+      t->wait_status->tid = t->tid;
+      t->wait_status->exit_code = -1;
+      sema_init (&t->wait_status->dead, 0);
+    }
+  return t->wait_status;
+}
+
+/* Starts running the user process set up in IF_, by simulating a
+   return from an interrupt, implemented by intr_exit (in
+   threads/intr-stubs.S).  Because intr_exit takes all of its
+   arguments on the stack in the form of a `struct intr_frame',
+   we just point the stack pointer (%esp) to our stack frame and
+   jump to it. */
+static void NO_RETURN
+start_user (struct intr_frame *if_) 
+{
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *exec_)
 {
-  char *file_name = file_name_;
+  struct exec_info *exec = exec_;
   struct intr_frame if_;
-  bool success;
+  char *cmd_line_copy, *file_name, *save_ptr;
+  bool success = false;
 
   
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
 
-  
-  palloc_free_page (file_name);
+  /* Load the program named by the first word of the command
+     line. */
+  cmd_line_copy = palloc_get_page (0);
+  if (cmd_line_copy != NULL) 
+    {
+      strlcpy (cmd_line_copy, exec->cmd_line, PGSIZE);
+      file_name = strtok_r (cmd_line_copy, " ", &save_ptr);
+      if (file_name != NULL) 
+        {
+          lock_acquire (&fs_lock);
+          success = load (file_name, &if_.eip);
+          lock_release (&fs_lock);
+        }
+      palloc_free_page (cmd_line_copy);
+    }
+
+  /* Setting up the stack may evict a page, which can take
+     fs_lock, so it must not be held here. */
+  if (success)
+    success = setup_stack (exec->cmd_line, &if_.esp);
+
+  /* Allocate wait_status and notify parent. */
+  exec->wait_status = success ? create_wait_status () : NULL;
+  exec->success = success = exec->wait_status != NULL;
+  sema_up (&exec->load_done);
   if (!success) 
     thread_exit ();
 
-  /* Start the user process by simulating a return from an
-     interrupt, implemented by intr_exit (in
-     threads/intr-stubs.S).  Because intr_exit takes all of its
-     arguments on the stack in the form of a `struct intr_frame',
-     we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
-  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
-  NOT_REACHED ();
+  start_user (&if_);
+}
+
+/* Releases one reference to CS and, if it is now unreferenced,
+   frees it. */
+static void
+release_child (struct wait_status *cs) 
+{
+  int new_ref_cnt;
+  
+  lock_acquire (&cs->lock);
+  new_ref_cnt = --cs->ref_cnt;
+  lock_release (&cs->lock);
+
+  if (new_ref_cnt == 0)
+    free (cs);
 }
 
 /* Waits for thread TID to die and returns its exit status.  If
@@ -81,23 +194,172 @@ start_process (void *file_name_)
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
 {
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e)) 
+    {
+      struct wait_status *cs = list_entry (e, struct wait_status, elem);
+      if (cs->tid == child_tid) 
+        {
+          int exit_code;
+          list_remove (e);
+          sema_down (&cs->dead);
+          exit_code = cs->exit_code;
+          release_child (cs);
+          return exit_code;
+        }
+    }
   return -1;
 }
 
+#ifdef VM
+/* Data structure shared between process_fork() in the parent
+   and fork_process() in the child. */
+struct fork_info 
+  {
+    struct thread *parent;              /* Forking process. */
+    struct intr_frame if_;              /* Parent's user context. */
+    struct semaphore done;              /* "Up"ed when copying complete. */
+    struct wait_status *wait_status;    /* Child process. */
+    bool success;                       /* Address space copied? */
+  };
+
+/* Returns the current process's copy of FILE, which belongs to
+   PARENT_, the process it is being forked from. */
+static struct file *
+fork_file (struct file *file, void *parent_) 
+{
+  struct thread *parent = parent_;
+
+  if (file == parent->exec_file)
+    return thread_current ()->exec_file;
+  return syscall_fork_file (parent, file);
+}
+
+/* A thread function that makes the current thread a copy of the
+   forking process and starts it running, returning 0 from
+   fork(). */
+static void
+fork_process (void *fork_) 
+{
+  struct fork_info *fork = fork_;
+  struct thread *parent = fork->parent;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = fork->if_;
+  bool success = false;
+
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir != NULL && page_table_init ()) 
+    {
+      process_activate ();
+      cur->user_esp = parent->user_esp;
+
+      lock_acquire (&fs_lock);
+      cur->exec_file = file_reopen (parent->exec_file);
+      if (cur->exec_file != NULL)
+        file_deny_write (cur->exec_file);
+      success = cur->exec_file != NULL && syscall_fork (parent);
+      lock_release (&fs_lock);
+
+      success = (success
+                 && page_fork (parent->pages, fork_file, parent)
+                 && create_wait_status () != NULL);
+    }
 
+  /* Notify parent, which may then return and release FORK. */
+  fork->wait_status = cur->wait_status;
+  fork->success = success;
+  sema_up (&fork->done);
+  if (!success)
+    thread_exit ();
+
+  if_.eax = 0;
+  start_user (&if_);
+}
+
+/* Creates a child of the current process, a copy of it that
+   shares its pages copy-on-write and its open files, and that
+   resumes from the user context in F as if returning 0 from a
+   system call.  Waits for the copy to be made.  Returns the
+   child's thread id, or TID_ERROR if the child cannot be
+   created. */
+tid_t
+process_fork (const struct intr_frame *f) 
+{
+  struct thread *cur = thread_current ();
+  struct fork_info fork;
+  tid_t tid;
+
+  fork.parent = cur;
+  fork.if_ = *f;
+  sema_init (&fork.done, 0);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, fork_process, &fork);
+  if (tid != TID_ERROR) 
+    {
+      sema_down (&fork.done);
+      if (fork.success)
+        list_push_back (&cur->children, &fork.wait_status->elem);
+      else
+        {
+          if (fork.wait_status != NULL)
+            release_child (fork.wait_status);
+          tid = TID_ERROR;
+        }
+    }
+  return tid;
+}
+#endif
+
+/* Free the current process's resources. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
   uint32_t *pd;
 
+  if (cur->pagedir != NULL)
+    printf ("%s: exit(%d)\n", cur->name, cur->exit_code);
+
+  /* Notify parent that we're dead. */
+  if (cur->wait_status != NULL) 
+    {
+      struct wait_status *cs = cur->wait_status;
+      cs->exit_code = cur->exit_code;
+      sema_up (&cs->dead);
+      release_child (cs);
+    }
+
+  /* Free entries of children list. */
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = next) 
+    {
+      struct wait_status *cs = list_entry (e, struct wait_status, elem);
+      next = list_remove (e);
+      release_child (cs);
+    }
+
+  /* Close open files and write back mapped files while the
+     process's pages can still be reached. */
+  syscall_exit ();
+
+#ifdef VM
+  /* Release the process's frames while its page directory still
+     exists. */
+  page_exit ();
+  lock_acquire (&fs_lock);
+  file_close (cur->exec_file);
+  lock_release (&fs_lock);
+  cur->exec_file = NULL;
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -195,18 +457,16 @@ struct Elf32_Phdr
 #define PF_W 2          
 #define PF_R 4          
 
-static bool setup_stack (void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
-   Stores the executable's entry point into *EIP
-   and its initial stack pointer into *ESP.
+   Stores the executable's entry point into *EIP.
    Returns true if successful, false otherwise. */
-bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+static bool
+load (const char *file_name, void (**eip) (void)) 
 {
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
@@ -220,6 +480,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
 
   
   file = filesys_open (file_name);
@@ -302,23 +566,30 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   
-  if (!setup_stack (esp))
-    goto done;
-
-  
   *eip = (void (*) (void)) ehdr.e_entry;
 
   success = true;
 
  done:
-  
+#ifdef VM
+  /* Keep the executable open while its pages may still have to
+     be read in, and keep it from being modified meanwhile. */
+  if (success)
+    {
+      file_deny_write (file);
+      t->exec_file = file;
+      return success;
+    }
+#endif
   file_close (file);
   return success;
 }
 
 
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -377,6 +648,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here, and read in or zeroed by the page fault handler
+   when the process first touches them.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -387,6 +662,28 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      struct page *p = page_allocate (upage, !writable);
+      if (p == NULL)
+        return false;
+      if (page_read_bytes > 0) 
+        {
+          p->file = file;
+          p->file_offset = ofs;
+          p->file_bytes = page_read_bytes;
+        }
+
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+  return true;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -422,28 +719,112 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+#endif
+}
+
+/* Pushes the SIZE bytes in BUF onto the stack in PAGE, whose
+   free space ends *OFS bytes from its start, padding to a
+   multiple of 32 bits.  Returns the address of the copy, or a
+   null pointer if PAGE is full. */
+static void *
+push (uint8_t *page, size_t *ofs, const void *buf, size_t size) 
+{
+  size_t padsize = ROUND_UP (size, sizeof (uint32_t));
+  if (*ofs < padsize)
+    return NULL;
+
+  *ofs -= padsize;
+  memcpy (page + *ofs + (padsize - size), buf, size);
+  return page + *ofs + (padsize - size);
+}
+
+/* Reverses the order of the CNT pointers in ARGV. */
+static void
+reverse (int cnt, char **argv) 
+{
+  int i;
+
+  for (i = 0; i < cnt / 2; i++) 
+    {
+      char *tmp = argv[i];
+      argv[i] = argv[cnt - 1 - i];
+      argv[cnt - 1 - i] = tmp;
+    }
+}
+
+/* Sets up the arguments from CMD_LINE on the user stack in
+   UPAGE, which must be mapped writable, the way main() expects
+   them: the argument strings, a null-terminated argv[] array,
+   argv, argc, and a null return address.  Stores the resulting
+   stack pointer into *ESP.  Returns true if successful, false
+   if the arguments do not fit in a page. */
+static bool
+init_cmd_line (uint8_t *upage, const char *cmd_line, void **esp) 
+{
+  size_t ofs = PGSIZE;
+  char *const null = NULL;
+  char *cmd_line_copy;
+  char *arg, *save_ptr;
+  char **argv;
+  int argc;
+
+  /* Push the command line, then split it into arguments in
+     place, pushing a pointer to each one. */
+  cmd_line_copy = push (upage, &ofs, cmd_line, strlen (cmd_line) + 1);
+  if (cmd_line_copy == NULL || push (upage, &ofs, &null, sizeof null) == NULL)
+    return false;
+  argc = 0;
+  for (arg = strtok_r (cmd_line_copy, " ", &save_ptr); arg != NULL;
+       arg = strtok_r (NULL, " ", &save_ptr)) 
+    {
+      if (push (upage, &ofs, &arg, sizeof arg) == NULL)
+        return false;
+      argc++;
+    }
+
+  /* The pointers were pushed last argument first. */
+  argv = (char **) (upage + ofs);
+  reverse (argc, argv);
+
+  if (push (upage, &ofs, &argv, sizeof argv) == NULL
+      || push (upage, &ofs, &argc, sizeof argc) == NULL
+      || push (upage, &ofs, &null, sizeof null) == NULL)
+    return false;
+
+  *esp = upage + ofs;
+  return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Creates the stack by mapping a zeroed page at the top of user
+   virtual memory and pushes the arguments from CMD_LINE on it.
+   The page is written through its user address, so it is marked
+   dirty and survives eviction like any other stack page. */
 static bool
-setup_stack (void **esp) 
+setup_stack (const char *cmd_line, void **esp) 
 {
-  uint8_t *kpage;
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+#ifdef VM
+  if (page_allocate (upage, false) != NULL && page_lock (upage, true)) 
+    {
+      success = init_cmd_line (upage, cmd_line, esp);
+      page_unlock (upage);
+    }
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
+      if (install_page (upage, kpage, true))
+        success = init_cmd_line (upage, cmd_line, esp);
       else
         palloc_free_page (kpage);
     }
+#endif
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -463,3 +844,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
@@ -1,20 +1,812 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/workset.h"
+#endif
+
+/* System call dispatch.
+
+   Arguments are copied in from the user stack with get_user(),
+   which returns false instead of faulting if the address is bad:
+   page_fault() resumes a kernel-mode fault on a user address at
+   the address stored in %eax.  Buffers handed to the file system
+   are instead locked into memory one page at a time, because a
+   page fault taken while holding FS_LOCK could need FS_LOCK to
+   read the faulting page back in. */
 
 static void syscall_handler (struct intr_frame *);
 
+static void sys_halt (void) NO_RETURN;
+static void sys_exit (int status) NO_RETURN;
+static int sys_exec (const char *ufile);
+static int sys_wait (tid_t);
+static int sys_create (const char *ufile, unsigned initial_size);
+static int sys_remove (const char *ufile);
+static int sys_open (const char *ufile);
+static int sys_filesize (int handle);
+static int sys_read (int handle, void *udst_, unsigned size);
+static int sys_write (int handle, void *usrc_, unsigned size);
+static void sys_seek (int handle, unsigned position);
+static int sys_tell (int handle);
+static void sys_close (int handle);
+#ifdef VM
+static int sys_mmap (int handle, void *addr);
+static void sys_munmap (int mapping);
+static int sys_memstat (tid_t, struct memstat *);
+static int sys_memlimit (tid_t, size_t pages);
+static void copy_out (void *, const void *, size_t);
+#endif
+
+static void copy_in (void *, const void *, size_t);
+static char *copy_in_string (const char *);
+
+struct lock fs_lock;
+
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  lock_init (&fs_lock);
+}
+
+/* Number of arguments taken by each system call, indexed by
+   SYS_* number.  Calls that are not implemented are omitted. */
+static const int arg_cnts[] =
+  {
+    [SYS_HALT] = 0, [SYS_EXIT] = 1, [SYS_EXEC] = 1, [SYS_WAIT] = 1,
+    [SYS_CREATE] = 2, [SYS_REMOVE] = 1, [SYS_OPEN] = 1,
+    [SYS_FILESIZE] = 1, [SYS_READ] = 3, [SYS_WRITE] = 3,
+    [SYS_SEEK] = 2, [SYS_TELL] = 1, [SYS_CLOSE] = 1, [SYS_YIELD] = 0,
+#ifdef VM
+    [SYS_MMAP] = 2, [SYS_MUNMAP] = 1, [SYS_FORK] = 0,
+    [SYS_MEMSTAT] = 2, [SYS_MEMLIMIT] = 2,
+#endif
+  };
+
+/* System call handler. */
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  unsigned call_nr;
+  int args[3];
+
+#ifdef VM
+  /* Page faults taken in the kernel on the process's behalf need
+     the user stack pointer to decide on stack growth. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  copy_in (&call_nr, f->esp, sizeof call_nr);
+  if (call_nr >= sizeof arg_cnts / sizeof *arg_cnts)
+    thread_exit ();
+
+  memset (args, 0, sizeof args);
+  copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnts[call_nr]);
+  switch (call_nr) 
+    {
+    case SYS_HALT:
+      sys_halt ();
+    case SYS_EXIT:
+      sys_exit (args[0]);
+    case SYS_EXEC:
+      f->eax = sys_exec ((const char *) args[0]);
+      break;
+    case SYS_WAIT:
+      f->eax = sys_wait (args[0]);
+      break;
+    case SYS_CREATE:
+      f->eax = sys_create ((const char *) args[0], args[1]);
+      break;
+    case SYS_REMOVE:
+      f->eax = sys_remove ((const char *) args[0]);
+      break;
+    case SYS_OPEN:
+      f->eax = sys_open ((const char *) args[0]);
+      break;
+    case SYS_FILESIZE:
+      f->eax = sys_filesize (args[0]);
+      break;
+    case SYS_READ:
+      f->eax = sys_read (args[0], (void *) args[1], args[2]);
+      break;
+    case SYS_WRITE:
+      f->eax = sys_write (args[0], (void *) args[1], args[2]);
+      break;
+    case SYS_SEEK:
+      sys_seek (args[0], args[1]);
+      break;
+    case SYS_TELL:
+      f->eax = sys_tell (args[0]);
+      break;
+    case SYS_CLOSE:
+      sys_close (args[0]);
+      break;
+    case SYS_YIELD:
+      thread_yield ();
+      break;
+#ifdef VM
+    case SYS_MMAP:
+      f->eax = sys_mmap (args[0], (void *) args[1]);
+      break;
+    case SYS_MUNMAP:
+      sys_munmap (args[0]);
+      break;
+    case SYS_FORK:
+      f->eax = process_fork (f);
+      break;
+    case SYS_MEMSTAT:
+      f->eax = sys_memstat (args[0], (struct memstat *) args[1]);
+      break;
+    case SYS_MEMLIMIT:
+      f->eax = sys_memlimit (args[0], args[1]);
+      break;
+#endif
+    default:
+      thread_exit ();
+    }
+}
+
+/* Copies a byte from user address USRC to kernel address DST.
+   USRC must be below PHYS_BASE.
+   Returns true if successful, false if a segfault occurred. */
+static inline bool
+get_user (uint8_t *dst, const uint8_t *usrc)
+{
+  int eax;
+  asm ("movl $1f, %%eax; movb %2, %%al; movb %%al, %0; 1:"
+       : "=m" (*dst), "=&a" (eax) : "m" (*usrc));
+  return eax != 0;
+}
+
+/* Writes BYTE to user address UDST.
+   UDST must be below PHYS_BASE.
+   Returns true if successful, false if a segfault occurred. */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int eax;
+  asm ("movl $1f, %%eax; movb %b2, %0; 1:"
+       : "=m" (*udst), "=&a" (eax) : "q" (byte));
+  return eax != 0;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.
+   Call thread_exit() if any of the user accesses are invalid. */
+static void
+copy_in (void *dst_, const void *usrc_, size_t size) 
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  for (; size > 0; size--, dst++, usrc++) 
+    if (usrc >= (uint8_t *) PHYS_BASE || !get_user (dst, usrc)) 
+      thread_exit ();
+}
+
+#ifdef VM
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.
+   Call thread_exit() if any of the user accesses are invalid. */
+static void
+copy_out (void *udst_, const void *src_, size_t size) 
+{
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  for (; size > 0; size--, udst++, src++) 
+    if (udst >= (uint8_t *) PHYS_BASE || !put_user (udst, *src)) 
+      thread_exit ();
+}
+#endif
+
+/* Creates a copy of user string US in kernel memory
+   and returns it as a page that must be freed with
+   palloc_free_page().
+   Truncates the string at PGSIZE bytes in size.
+   Call thread_exit() if any of the user accesses are invalid. */
+static char *
+copy_in_string (const char *us) 
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL) 
+    thread_exit ();
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      if (us >= (char *) PHYS_BASE || !get_user ((uint8_t *) ks + length, 
+                                                 (uint8_t *) us++)) 
+        {
+          palloc_free_page (ks);
+          thread_exit (); 
+        }
+
+      if (ks[length] == '\0')
+        return ks;
+    }
+  ks[PGSIZE - 1] = '\0';
+  return ks;
+}
+
+/* Makes the page containing user address UADDR safe for the
+   kernel to access while holding FS_LOCK, and writable if
+   WILL_WRITE is true.  With VM, the page is paged in and locked
+   into memory until unlock_user_page() is called.  Without VM,
+   every valid page is always resident, so touching it is
+   enough.
+   Returns true if successful, false if the access is invalid. */
+static bool
+lock_user_page (uint8_t *uaddr, bool will_write) 
+{
+#ifdef VM
+  return is_user_vaddr (uaddr) && page_lock (uaddr, will_write);
+#else
+  uint8_t byte;
+  return (is_user_vaddr (uaddr)
+          && get_user (&byte, uaddr)
+          && (!will_write || put_user (uaddr, byte)));
+#endif
+}
+
+/* Undoes lock_user_page() on UADDR. */
+static void
+unlock_user_page (uint8_t *uaddr UNUSED) 
+{
+#ifdef VM
+  page_unlock (uaddr);
+#endif
+}
+
+/* Halt system call. */
+static void
+sys_halt (void)
+{
+  shutdown_power_off ();
+}
+
+/* Exit system call. */
+static void
+sys_exit (int exit_code) 
+{
+  thread_current ()->exit_code = exit_code;
+  thread_exit ();
+}
+
+/* Exec system call. */
+static int
+sys_exec (const char *ufile) 
+{
+  tid_t tid;
+  char *kfile = copy_in_string (ufile);
+
+  tid = process_execute (kfile);
+  palloc_free_page (kfile);
+  return tid;
+}
+
+/* Wait system call. */
+static int
+sys_wait (tid_t child) 
+{
+  return process_wait (child);
+}
+
+/* Create system call. */
+static int
+sys_create (const char *ufile, unsigned initial_size) 
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  lock_acquire (&fs_lock);
+  ok = filesys_create (kfile, initial_size);
+  lock_release (&fs_lock);
+
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* Remove system call. */
+static int
+sys_remove (const char *ufile) 
+{
+  char *kfile = copy_in_string (ufile);
+  bool ok;
+
+  lock_acquire (&fs_lock);
+  ok = filesys_remove (kfile);
+  lock_release (&fs_lock);
+
+  palloc_free_page (kfile);
+  return ok;
+}
+
+/* A file descriptor, for binding a file handle to a file. */
+struct file_descriptor
+  {
+    struct list_elem elem;      /* List element. */
+    struct file *file;          /* File. */
+    int handle;                 /* File handle. */
+  };
+
+/* Open system call. */
+static int
+sys_open (const char *ufile) 
+{
+  char *kfile = copy_in_string (ufile);
+  struct file_descriptor *fd;
+  int handle = -1;
+
+  fd = malloc (sizeof *fd);
+  if (fd != NULL)
+    {
+      lock_acquire (&fs_lock);
+      fd->file = filesys_open (kfile);
+      if (fd->file != NULL)
+        {
+          struct thread *cur = thread_current ();
+          handle = fd->handle = cur->next_handle++;
+          list_push_front (&cur->fds, &fd->elem);
+        }
+      else 
+        free (fd);
+      lock_release (&fs_lock);
+    }
+  
+  palloc_free_page (kfile);
+  return handle;
+}
+
+/* Returns the file descriptor associated with the given handle.
+   Terminates the process if HANDLE is not associated with an
+   open file. */
+static struct file_descriptor *
+lookup_fd (int handle)
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+   
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      if (fd->handle == handle)
+        return fd;
+    }
+
+  thread_exit ();
+}
+
+/* Filesize system call. */
+static int
+sys_filesize (int handle) 
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  int size;
+
+  lock_acquire (&fs_lock);
+  size = file_length (fd->file);
+  lock_release (&fs_lock);
+
+  return size;
+}
+
+/* Read system call. */
+static int
+sys_read (int handle, void *udst_, unsigned size) 
+{
+  uint8_t *udst = udst_;
+  struct file_descriptor *fd;
+  int bytes_read = 0;
+
+  /* Handle keyboard reads. */
+  if (handle == STDIN_FILENO) 
+    {
+      for (bytes_read = 0; (size_t) bytes_read < size; bytes_read++)
+        if (udst >= (uint8_t *) PHYS_BASE || !put_user (udst++, input_getc ()))
+          thread_exit ();
+      return bytes_read;
+    }
+
+  /* Handle all other reads. */
+  fd = lookup_fd (handle);
+  while (size > 0) 
+    {
+      /* How much to read into this page? */
+      size_t page_left = PGSIZE - pg_ofs (udst);
+      size_t read_amt = size < page_left ? size : page_left;
+      off_t retval;
+
+      /* Read from file into page. */
+      if (!lock_user_page (udst, true))
+        thread_exit ();
+      lock_acquire (&fs_lock);
+      retval = file_read (fd->file, udst, read_amt);
+      lock_release (&fs_lock);
+      unlock_user_page (udst);
+
+      /* Check success. */
+      if (retval < 0)
+        {
+          if (bytes_read == 0)
+            bytes_read = -1; 
+          break;
+        }
+      bytes_read += retval;
+
+      /* If it was a short read we're done. */
+      if (retval != (off_t) read_amt)
+        break;
+
+      /* Advance. */
+      udst += retval;
+      size -= retval;
+    }
+   
+  return bytes_read;
+}
+
+/* Write system call. */
+static int
+sys_write (int handle, void *usrc_, unsigned size) 
+{
+  uint8_t *usrc = usrc_;
+  struct file_descriptor *fd = NULL;
+  int bytes_written = 0;
+
+  /* Lookup up file descriptor. */
+  if (handle != STDOUT_FILENO)
+    fd = lookup_fd (handle);
+
+  while (size > 0) 
+    {
+      /* How much bytes to write to this page? */
+      size_t page_left = PGSIZE - pg_ofs (usrc);
+      size_t write_amt = size < page_left ? size : page_left;
+      off_t retval;
+
+      /* Write from page into file. */
+      if (!lock_user_page (usrc, false)) 
+        thread_exit ();
+      if (handle == STDOUT_FILENO)
+        {
+          putbuf ((char *) usrc, write_amt);
+          retval = write_amt;
+        }
+      else
+        {
+          lock_acquire (&fs_lock);
+          retval = file_write (fd->file, usrc, write_amt);
+          lock_release (&fs_lock);
+        }
+      unlock_user_page (usrc);
+
+      /* Handle return value. */
+      if (retval < 0) 
+        {
+          if (bytes_written == 0)
+            bytes_written = -1;
+          break;
+        }
+      bytes_written += retval;
+
+      /* If it was a short write we're done. */
+      if (retval != (off_t) write_amt)
+        break;
+
+      /* Advance. */
+      usrc += retval;
+      size -= retval;
+    }
+ 
+  return bytes_written;
+}
+
+/* Seek system call. */
+static void
+sys_seek (int handle, unsigned position) 
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+   
+  lock_acquire (&fs_lock);
+  if ((off_t) position >= 0)
+    file_seek (fd->file, position);
+  lock_release (&fs_lock);
+}
+
+/* Tell system call. */
+static int
+sys_tell (int handle) 
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  unsigned position;
+   
+  lock_acquire (&fs_lock);
+  position = file_tell (fd->file);
+  lock_release (&fs_lock);
+
+  return position;
 }
 
+/* Close system call. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+sys_close (int handle) 
 {
-  printf ("system call!\n");
+  struct file_descriptor *fd = lookup_fd (handle);
+
+  lock_acquire (&fs_lock);
+  file_close (fd->file);
+  lock_release (&fs_lock);
+  list_remove (&fd->elem);
+  free (fd);
+}
+
+#ifdef VM
+/* Binds a mapping id to a region of memory and a file. */
+struct mapping
+  {
+    struct list_elem elem;      /* List element. */
+    int handle;                 /* Mapping id. */
+    struct file *file;          /* File. */
+    uint8_t *base;              /* Start of memory mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+  };
+
+/* Returns the mapping associated with the given handle.
+   Terminates the process if HANDLE is not associated with a
+   memory mapping. */
+static struct mapping *
+lookup_mapping (int handle) 
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->mappings); e != list_end (&cur->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->handle == handle)
+        return m;
+    }
+
   thread_exit ();
 }
+
+/* Remove mapping M from the virtual address space,
+   writing back any pages that have changed. */
+static void
+unmap (struct mapping *m) 
+{
+  size_t i;
+
+  list_remove (&m->elem);
+  for (i = 0; i < m->page_cnt; i++)
+    page_deallocate (m->base + PGSIZE * i);
+
+  lock_acquire (&fs_lock);
+  file_close (m->file);
+  lock_release (&fs_lock);
+  free (m);
+}
+
+/* Mmap system call.
+
+   Maps the file open as HANDLE at ADDR.  The file is reopened,
+   so the mapping survives the handle being closed.  Its pages
+   are read in on demand, and all processes that map the same
+   page of the same file share one frame. */
+static int
+sys_mmap (int handle, void *addr)
+{
+  struct file_descriptor *fd = lookup_fd (handle);
+  struct mapping *m = malloc (sizeof *m);
+  size_t offset;
+  off_t length;
+
+  if (m == NULL || addr == NULL || pg_ofs (addr) != 0)
+    {
+      free (m);
+      return -1;
+    }
+
+  m->handle = thread_current ()->next_handle++;
+  lock_acquire (&fs_lock);
+  m->file = file_reopen (fd->file);
+  lock_release (&fs_lock);
+  if (m->file == NULL) 
+    {
+      free (m);
+      return -1;
+    }
+  m->base = addr;
+  m->page_cnt = 0;
+  list_push_front (&thread_current ()->mappings, &m->elem);
+
+  offset = 0;
+  lock_acquire (&fs_lock);
+  length = file_length (m->file);
+  lock_release (&fs_lock);
+  if (length == 0)
+    {
+      unmap (m);
+      return -1;
+    }
+  while (length > 0)
+    {
+      uint8_t *uaddr = (uint8_t *) addr + offset;
+      struct page *p = NULL;
+
+      if (is_user_vaddr (uaddr))
+        p = page_allocate (uaddr, false);
+      if (p == NULL)
+        {
+          unmap (m);
+          return -1;
+        }
+      p->private = false;
+      p->file = m->file;
+      p->file_offset = offset;
+      p->file_bytes = length >= PGSIZE ? PGSIZE : length;
+      offset += p->file_bytes;
+      length -= p->file_bytes;
+      m->page_cnt++;
+    }
+  
+  return m->handle;
+}
+
+/* Munmap system call. */
+static void
+sys_munmap (int mapping) 
+{
+  unmap (lookup_mapping (mapping));
+}
+
+/* Memstat system call. */
+static int
+sys_memstat (tid_t pid, struct memstat *um) 
+{
+  struct memstat m;
+
+  if (pid == MEMSTAT_SELF)
+    pid = thread_current ()->tid;
+  if (!workset_get (pid, &m))
+    return false;
+  copy_out (um, &m, sizeof m);
+  return true;
+}
+
+/* Memlimit system call. */
+static int
+sys_memlimit (tid_t pid, size_t pages) 
+{
+  if (pid == MEMSTAT_SELF)
+    pid = thread_current ()->tid;
+  return workset_set_limit (pid, pages);
+}
+#endif
+
+/* Gives the current process, a child being forked from PARENT,
+   its own copies of PARENT's open files, with the same handles
+   and positions, and of its file mappings, whose pages are set
+   up by page_fork().  The caller must hold fs_lock.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+syscall_fork (struct thread *parent) 
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&fs_lock));
+
+  for (e = list_begin (&parent->fds); e != list_end (&parent->fds);
+       e = list_next (e))
+    {
+      struct file_descriptor *pfd, *fd;
+      pfd = list_entry (e, struct file_descriptor, elem);
+      fd = malloc (sizeof *fd);
+      if (fd == NULL)
+        return false;
+      fd->file = file_reopen (pfd->file);
+      if (fd->file == NULL) 
+        {
+          free (fd);
+          return false;
+        }
+      file_seek (fd->file, file_tell (pfd->file));
+      fd->handle = pfd->handle;
+      list_push_back (&cur->fds, &fd->elem);
+    }
+
+#ifdef VM
+  for (e = list_begin (&parent->mappings); e != list_end (&parent->mappings);
+       e = list_next (e))
+    {
+      struct mapping *pm, *m;
+      pm = list_entry (e, struct mapping, elem);
+      m = malloc (sizeof *m);
+      if (m == NULL)
+        return false;
+      m->file = file_reopen (pm->file);
+      if (m->file == NULL) 
+        {
+          free (m);
+          return false;
+        }
+      m->handle = pm->handle;
+      m->base = pm->base;
+      m->page_cnt = pm->page_cnt;
+      list_push_back (&cur->mappings, &m->elem);
+    }
+#endif
+
+  cur->next_handle = parent->next_handle;
+  return true;
+}
+
+#ifdef VM
+/* Returns the current process's copy, made by syscall_fork(), of
+   FILE, which PARENT has mapped, or a null pointer if PARENT has
+   not mapped FILE. */
+struct file *
+syscall_fork_file (struct thread *parent, struct file *file) 
+{
+  struct list_elem *pe, *e;
+
+  for (pe = list_begin (&parent->mappings),
+         e = list_begin (&thread_current ()->mappings);
+       pe != list_end (&parent->mappings);
+       pe = list_next (pe), e = list_next (e))
+    if (list_entry (pe, struct mapping, elem)->file == file)
+      return list_entry (e, struct mapping, elem)->file;
+  return NULL;
+}
+#endif
+
+/* On thread exit, close all open files and unmap all mappings. */
+void
+syscall_exit (void) 
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
+
+#ifdef VM
+  for (e = list_begin (&cur->mappings); e != list_end (&cur->mappings);
+       e = next)
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      next = list_next (e);
+      unmap (m);
+    }
+#endif
+
+  for (e = list_begin (&cur->fds); e != list_end (&cur->fds); e = next)
+    {
+      struct file_descriptor *fd;
+      fd = list_entry (e, struct file_descriptor, elem);
+      next = list_next (e);
+      lock_acquire (&fs_lock);
+      file_close (fd->file);
+      lock_release (&fs_lock);
+      free (fd);
+    }
+}
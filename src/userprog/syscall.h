@@ -1,6 +1,18 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
+/* Serializes access to the file system, which is not itself
+   thread-safe. */
+extern struct lock fs_lock;
+
+struct file;
+struct thread;
+
 void syscall_init (void);
+void syscall_exit (void);
+bool syscall_fork (struct thread *parent);
+struct file *syscall_fork_file (struct thread *parent, struct file *);
 
 #endif 
@@ -0,0 +1,613 @@
+#include "vm/frame.h"
+#include <stdio.h>
+#include <string.h>
+#include "vm/page.h"
+#include "vm/swap.h"
+#include "vm/workset.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+
+/* Frame table.
+
+   At startup we take every page of the user pool and keep it in
+   FRAMES.  Each frame records the process pages that map it,
+   and thus their owners (the pages' threads).  Usually there is
+   just one, but a frame that caches a page of a file mapped with
+   mmap(), or a read-only page of an executable, is entered in
+   the SHARED table under the file's inode and offset, so that
+   every process that maps that page of the file shares the
+   frame.  Processes that map the file see each other's writes;
+   processes that run the same program share its code.  A shared
+   frame may also hold file data that was read ahead (see
+   prefetch.c) before any process maps it.  A frame in SHARED
+   holds a reference to its inode, so that the inode cannot be
+   freed, and its address reused for another file's inode, while
+   the frame is entered under it.  After
+   fork(), a parent and child also share each of the parent's
+   resident private frames, copy-on-write: neither may write the
+   frame until frame_copy_and_lock() gives it its own copy.
+
+   When no frame is free, we pick a victim with the clock
+   (second-chance) algorithm: the hand sweeps over the frames,
+   giving each page whose accessed bit is set another chance
+   after clearing the bit, and evicting the first page that has
+   not been accessed since the hand last passed it.  A modified
+   victim is written to swap together with the modified pages
+   the hand will reach next.  While any process is over its
+   resident set limit (see workset.c), the hand first makes its
+   sweeps over only the frames of such processes, and moves on
+   to everyone else's only if none of those can be evicted.
+
+   Each frame has a lock.  Whoever changes a frame's page, or
+   reads or writes the frame's contents on the page's behalf,
+   must hold it.  SCAN_LOCK serializes searches for a frame.
+   SHARED_LOCK protects the SHARED table; it is never held while
+   waiting for a frame's lock. */
+
+static struct frame *frames;
+static size_t frame_cnt;
+
+static struct lock scan_lock;
+static size_t hand;
+
+static struct hash shared;
+static struct lock shared_lock;
+
+static hash_hash_func frame_hash;
+static hash_less_func frame_less;
+
+/* Statistics. */
+static unsigned long long evict_cnt;
+static unsigned long long copy_cnt;
+
+/* Frames saved by sharing: the number of pages mapped, less the
+   number of frames they map. */
+static size_t saved_cnt;
+static size_t saved_peak;
+
+/* Adds DELTA to saved_cnt. */
+static void
+count_saved (int delta) 
+{
+  enum intr_level old_level = intr_disable ();
+  saved_cnt += delta;
+  if (saved_cnt > saved_peak)
+    saved_peak = saved_cnt;
+  intr_set_level (old_level);
+}
+
+/* Initializes the frame table. */
+void
+frame_init (void) 
+{
+  void *base;
+
+  lock_init (&scan_lock);
+  lock_init (&shared_lock);
+  if (!hash_init (&shared, frame_hash, frame_less, NULL))
+    PANIC ("out of memory allocating shared frame table");
+
+  frames = malloc (sizeof *frames * init_ram_pages);
+  if (frames == NULL)
+    PANIC ("out of memory allocating page frames");
+
+  while ((base = palloc_get_page (PAL_USER)) != NULL) 
+    {
+      struct frame *f = &frames[frame_cnt++];
+      lock_init (&f->lock);
+      f->base = base;
+      list_init (&f->pages);
+      f->inode = NULL;
+    }
+}
+
+/* Adds PAGE to the pages that map locked frame F. */
+void
+frame_attach (struct frame *f, struct page *page) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  if (!list_empty (&f->pages))
+    count_saved (1);
+  list_push_back (&f->pages, &page->frame_elem);
+}
+
+/* Enters locked frame F in the shared frame table as caching
+   LENGTH bytes of INODE at OFFSET, and takes a reference to
+   INODE for it.  The caller must hold a reference to INODE too.
+   Returns true if successful, false if another frame is already
+   entered for the same data. */
+static bool
+share (struct frame *f, struct inode *inode, off_t offset, off_t length) 
+{
+  bool success;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->inode == NULL);
+
+  f->inode = inode;
+  f->offset = offset;
+  f->length = length;
+  lock_acquire (&shared_lock);
+  success = hash_insert (&shared, &f->hash_elem) == NULL;
+  lock_release (&shared_lock);
+
+  if (success) 
+    {
+      lock_acquire (&fs_lock);
+      inode_reopen (inode);
+      lock_release (&fs_lock);
+    }
+  else
+    f->inode = NULL;
+  return success;
+}
+
+/* Removes locked frame F from the shared frame table, if it is
+   in it, and drops its reference to its inode. */
+static void
+unshare (struct frame *f) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  if (f->inode != NULL) 
+    {
+      struct inode *inode = f->inode;
+
+      lock_acquire (&shared_lock);
+      hash_delete (&shared, &f->hash_elem);
+      f->inode = NULL;
+      lock_release (&shared_lock);
+
+      lock_acquire (&fs_lock);
+      inode_close (inode);
+      lock_release (&fs_lock);
+    }
+}
+
+/* Returns true if any page mapping locked frame F has been
+   modified. */
+static bool
+frame_is_dirty (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_is_dirty (list_entry (e, struct page, frame_elem)))
+      return true;
+  return false;
+}
+
+/* Returns true if any page mapping locked frame F has been
+   accessed since the last call, and clears all of their accessed
+   bits. */
+static bool
+frame_accessed_recently (struct frame *f) 
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (page_accessed_recently (list_entry (e, struct page, frame_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Evicts the pages in locked frame F, which the clock hand has
+   just passed, and empties F.  If F must be written to swap, the
+   dirty private frames right after it, which the hand would
+   reach next, are written in the same batch.
+   Returns true if successful, false if F could not be
+   evicted. */
+static bool
+evict (struct frame *f) 
+{
+  struct frame *neighbors[SWAP_CLUSTER - 1];
+  size_t cnt = 0;
+  size_t i;
+  bool success;
+
+  if (f->inode == NULL && frame_is_dirty (f))
+    for (i = 0; i < SWAP_CLUSTER - 1 && i + 1 < frame_cnt; i++) 
+      {
+        struct frame *g = &frames[(hand + i) % frame_cnt];
+        if (g == f || !lock_try_acquire (&g->lock))
+          continue;
+        if (g->inode == NULL && !list_empty (&g->pages) && frame_is_dirty (g))
+          neighbors[cnt++] = g;
+        else
+          lock_release (&g->lock);
+      }
+
+  /* A frame that was read ahead but never mapped holds a clean
+     copy of its file data, so it can just be dropped. */
+  success = list_empty (&f->pages) || page_out (f, neighbors, cnt);
+  if (success)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        workset_evicted (list_entry (e, struct page, frame_elem)->thread);
+      if (!list_empty (&f->pages))
+        count_saved (1 - (int) list_size (&f->pages));
+      list_init (&f->pages);
+      unshare (f);
+      evict_cnt++;
+    }
+
+  for (i = 0; i < cnt; i++)
+    lock_release (&neighbors[i]->lock);
+  return success;
+}
+
+/* Returns true if locked frame F is free. */
+static bool
+is_free (struct frame *f) 
+{
+  return list_empty (&f->pages) && f->inode == NULL;
+}
+
+/* Returns a free frame, locked, or a null pointer if no frame is
+   free.  The caller must hold scan_lock. */
+static struct frame *
+find_free_and_lock (void) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&scan_lock));
+
+  for (i = 0; i < frame_cnt; i++)
+    {
+      struct frame *f = &frames[i];
+      if (!lock_try_acquire (&f->lock))
+        continue;
+      if (is_free (f))
+        return f;
+      lock_release (&f->lock);
+    }
+  return NULL;
+}
+
+/* Returns true if every page that maps locked frame F belongs
+   to a process over its resident set limit. */
+static bool
+frame_over_limit (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (!workset_over_limit (list_entry (e, struct page, frame_elem)->thread))
+      return false;
+  return !list_empty (&f->pages);
+}
+
+/* Sweeps the clock hand over the frames looking for a free frame
+   or one to evict, considering for eviction only the frames of
+   processes over their limits if OVER_LIMIT.  Returns the frame,
+   emptied and locked, or a null pointer if none was found.  The
+   caller must hold scan_lock. */
+static struct frame *
+sweep_and_lock (bool over_limit) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&scan_lock));
+
+  /* Two full sweeps are enough to find any page that can be
+     evicted, because the first one clears every accessed bit. */
+  for (i = 0; i < frame_cnt * 2; i++) 
+    {
+      struct frame *f = &frames[hand];
+      if (++hand >= frame_cnt)
+        hand = 0;
+
+      if (!lock_try_acquire (&f->lock))
+        continue;
+
+      if (is_free (f))
+        return f;
+
+      if ((over_limit && !frame_over_limit (f))
+          || frame_accessed_recently (f)) 
+        {
+          lock_release (&f->lock);
+          continue;
+        }
+          
+      if (evict (f))
+        return f;
+      lock_release (&f->lock);
+    }
+  return NULL;
+}
+
+/* Allocates and locks a frame for PAGE, evicting another page if
+   necessary.
+   Returns the frame if successful, a null pointer if no page
+   could be evicted. */
+struct frame *
+frame_alloc_and_lock (struct page *page) 
+{
+  struct frame *f;
+
+  lock_acquire (&scan_lock);
+
+  /* Find a free frame, or failing that, a frame to evict. */
+  f = find_free_and_lock ();
+  if (f == NULL && workset_any_over_limit ())
+    f = sweep_and_lock (true);
+  if (f == NULL)
+    f = sweep_and_lock (false);
+  if (f != NULL)
+    frame_attach (f, page);
+
+  lock_release (&scan_lock);
+  return f;
+}
+
+/* Returns the shared frame that caches LENGTH bytes of INODE at
+   OFFSET, locked, or a null pointer if there is none. */
+static struct frame *
+lookup_shared_and_lock (struct inode *inode, off_t offset, off_t length) 
+{
+  for (;;) 
+    {
+      struct frame key;
+      struct hash_elem *e;
+      struct frame *f;
+
+      key.inode = inode;
+      key.offset = offset;
+      key.length = length;
+      lock_acquire (&shared_lock);
+      e = hash_find (&shared, &key.hash_elem);
+      f = e != NULL ? hash_entry (e, struct frame, hash_elem) : NULL;
+      lock_release (&shared_lock);
+      if (f == NULL)
+        return NULL;
+
+      /* The frame may have been evicted or reused while we
+         waited for its lock. */
+      lock_acquire (&f->lock);
+      if (f->inode == inode && f->offset == offset && f->length == length)
+        return f;
+      lock_release (&f->lock);
+    }
+}
+
+/* Finds or allocates the frame that caches LENGTH bytes of
+   INODE at OFFSET, followed by zeroes, for PAGE, adds PAGE to it,
+   and returns it locked.  Sets *FILL to
+   true if the frame was newly allocated, in which case the
+   caller must read the data into it, or call frame_free() on
+   failure, before unlocking it; other processes that want the
+   same page wait for the frame's lock meanwhile.
+   Returns a null pointer if no frame could be allocated. */
+struct frame *
+frame_share_and_lock (struct page *page, struct inode *inode, off_t offset,
+                      off_t length, bool *fill) 
+{
+  for (;;) 
+    {
+      struct frame *f = lookup_shared_and_lock (inode, offset, length);
+      if (f != NULL) 
+        {
+          frame_attach (f, page);
+          *fill = false;
+          return f;
+        }
+
+      f = frame_alloc_and_lock (page);
+      if (f == NULL)
+        return NULL;
+
+      if (share (f, inode, offset, length)) 
+        {
+          *fill = true;
+          return f;
+        }
+
+      /* Another process got there first.  Use its frame. */
+      frame_free (f);
+    }
+}
+
+/* Adds PAGE to the shared frame that caches LENGTH bytes of
+   INODE at OFFSET, if there is one, and returns it locked.
+   Returns a null pointer if no such frame exists. */
+struct frame *
+frame_find_shared_and_lock (struct page *page, struct inode *inode,
+                            off_t offset, off_t length) 
+{
+  struct frame *f = lookup_shared_and_lock (inode, offset, length);
+  if (f != NULL)
+    frame_attach (f, page);
+  return f;
+}
+
+/* Allocates a free frame, without evicting anything, to cache
+   LENGTH bytes of INODE at OFFSET before any process maps them,
+   and enters it in the shared frame table.  Returns the frame
+   locked; the caller must read the data into it, or call
+   frame_free() on failure, before unlocking it.  Returns a null
+   pointer if the data is already cached or no frame is free. */
+struct frame *
+frame_prefetch_and_lock (struct inode *inode, off_t offset, off_t length) 
+{
+  struct frame *f;
+
+  lock_acquire (&scan_lock);
+  f = find_free_and_lock ();
+  lock_release (&scan_lock);
+  if (f == NULL)
+    return NULL;
+
+  if (share (f, inode, offset, length))
+    return f;
+  lock_release (&f->lock);
+  return NULL;
+}
+
+/* Locks P's frame into memory, if it has one.
+   Upon return, p->frame will not change until P is unlocked. */
+void
+frame_lock (struct page *p) 
+{
+  /* A frame can be asynchronously removed, but never inserted. */
+  struct frame *f = p->frame;
+  if (f != NULL) 
+    {
+      lock_acquire (&f->lock);
+      if (f != p->frame)
+        {
+          lock_release (&f->lock);
+          ASSERT (p->frame == NULL); 
+        } 
+    }
+}
+
+/* Moves page P out of its frame, which must be locked and must
+   be shared with other pages, into a new frame holding a copy of
+   its data.  Unlocks P's old frame.
+   Returns the new frame, locked, if successful.  On failure,
+   returns a null pointer and leaves P in its old frame, which
+   stays locked. */
+struct frame *
+frame_copy_and_lock (struct page *p) 
+{
+  struct frame *old = p->frame;
+  struct frame *new;
+
+  ASSERT (lock_held_by_current_thread (&old->lock));
+  ASSERT (list_size (&old->pages) > 1);
+
+  /* While P is in no frame's list, eviction cannot reach it, and
+     OLD, being locked, cannot be evicted either. */
+  list_remove (&p->frame_elem);
+  count_saved (-1);
+  new = frame_alloc_and_lock (p);
+  if (new == NULL) 
+    {
+      frame_attach (old, p);
+      return NULL;
+    }
+
+  memcpy (new->base, old->base, PGSIZE);
+  p->frame = new;
+  copy_cnt++;
+  lock_release (&old->lock);
+  return new;
+}
+
+/* Removes page P from frame F, which must be P's frame and be
+   locked for use by the current process, and unlocks F.  F is
+   freed once no page maps it. */
+void
+frame_detach (struct frame *f, struct page *p) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (p->frame == f);
+
+  list_remove (&p->frame_elem);
+  p->frame = NULL;
+  if (list_empty (&f->pages))
+    unshare (f);
+  else
+    count_saved (-1);
+  lock_release (&f->lock);
+}
+
+/* Releases frame F for use by another page, removing every page
+   that maps it.
+   F must be locked for use by the current process.
+   Any data in F is lost. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (!list_empty (&f->pages))
+    count_saved (1 - (int) list_size (&f->pages));
+  while (!list_empty (&f->pages)) 
+    {
+      struct page *p = list_entry (list_pop_front (&f->pages),
+                                   struct page, frame_elem);
+      p->frame = NULL;
+    }
+  unshare (f);
+  lock_release (&f->lock);
+}
+
+/* Unlocks frame F, allowing it to be evicted.
+   F must be locked for use by the current process. */
+void
+frame_unlock (struct frame *f) 
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
+
+/* Calls FUNC for each page that maps a frame, with the frame
+   locked, passing AUX along.  Frames that are locked already are
+   skipped, because their holders may be waiting for a frame
+   lock of their own. */
+void
+frame_for_each_page (frame_page_func *func, void *aux) 
+{
+  size_t i;
+
+  for (i = 0; i < frame_cnt; i++) 
+    {
+      struct frame *f = &frames[i];
+      struct list_elem *e;
+
+      if (!lock_try_acquire (&f->lock))
+        continue;
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        func (list_entry (e, struct page, frame_elem), aux);
+      lock_release (&f->lock);
+    }
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void) 
+{
+  printf ("Frame: %zu frames, %zu shared, %llu evictions, "
+          "%llu copied on write\n",
+          frame_cnt, hash_size (&shared), evict_cnt, copy_cnt);
+  printf ("Frame: sharing saves %zu kB, %zu kB at peak\n",
+          saved_cnt * PGSIZE / 1024, saved_peak * PGSIZE / 1024);
+}
+
+/* Returns a hash value for the shared frame that E refers to. */
+static unsigned
+frame_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->offset);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->offset != b->offset)
+    return a->offset < b->offset;
+  return a->length < b->length;
+}
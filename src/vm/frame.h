@@ -0,0 +1,52 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct inode;
+struct page;
+
+/* A physical frame in the user pool. */
+struct frame 
+  {
+    struct lock lock;           /* Prevent simultaneous access. */
+    void *base;                 /* Kernel virtual base address. */
+    struct list pages;          /* Process pages mapping this frame. */
+
+    /* If INODE is nonnull, the frame caches LENGTH bytes of
+       INODE at OFFSET, followed by zeroes, and every process that
+       maps that page of the file maps this frame. */
+    struct inode *inode;        /* Inode, or null if not shared. */
+    off_t offset;               /* Offset in inode. */
+    off_t length;               /* Bytes of file data, 1...PGSIZE. */
+    struct hash_elem hash_elem; /* `shared' hash element. */
+  };
+
+void frame_init (void);
+
+struct frame *frame_alloc_and_lock (struct page *);
+struct frame *frame_share_and_lock (struct page *, struct inode *,
+                                    off_t offset, off_t length, bool *fill);
+struct frame *frame_find_shared_and_lock (struct page *, struct inode *,
+                                          off_t offset, off_t length);
+struct frame *frame_prefetch_and_lock (struct inode *, off_t offset,
+                                       off_t length);
+void frame_lock (struct page *);
+
+void frame_attach (struct frame *, struct page *);
+struct frame *frame_copy_and_lock (struct page *);
+void frame_detach (struct frame *, struct page *);
+void frame_free (struct frame *);
+void frame_unlock (struct frame *);
+
+/* Called for a resident page by frame_for_each_page(). */
+typedef void frame_page_func (struct page *, void *aux);
+void frame_for_each_page (frame_page_func *, void *aux);
+
+void frame_print_stats (void);
+
+#endif
@@ -0,0 +1,827 @@
+#include "vm/page.h"
+#include <round.h>
+#include <string.h>
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/prefetch.h"
+#include "vm/swap.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+
+/* Supplemental page table.
+
+   Each process keeps a hash table of the pages in its address
+   space, keyed by user virtual address.  The ELF loader only
+   records where each page's contents come from; the page fault
+   handler calls page_in() to allocate a frame and fill it the
+   first time the page is touched.  The stack starts out as a
+   single page and grows on demand, one zero-filled page at a
+   time, when the process touches memory just below its stack
+   pointer.
+
+   Frames come from the frame table (frame.c), which may evict a
+   page to make room.  A page that was modified is written to swap
+   (swap.c) and read back from there.  A page that still matches
+   its file, its swap slot, or zeroes is simply dropped.
+
+   Pages of a file mapping (see sys_mmap()) are not private: they
+   are written back to the file instead of to swap, and all
+   mappings of the same page of a file share one frame.
+
+   fork() copies the page table (page_fork()).  The child shares
+   each of the parent's resident private pages copy-on-write: both
+   map the frame read-only, and a write fault gives the writer its
+   own copy (page_copy_on_write()). */
+
+/* Maximum size of a process's stack, in pages.
+   Controlled by kernel command-line option "-sl". */
+size_t stack_page_limit = STACK_PAGE_LIMIT_DEFAULT;
+
+/* Each page fault also maps the pages in the aligned window of
+   this many pages around the faulting page whose data is already
+   in memory, either in this process's frames or in the shared
+   frame table, so that it never has to allocate or evict a
+   frame.  When faults move forward through memory, it also reads
+   ahead the file pages in the next window.  0 or 1 disables all
+   of this.
+   Controlled by kernel command-line option "-fa". */
+size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+
+/* Statistics. */
+static unsigned long long around_cnt;   /* Pages mapped around faults. */
+static unsigned long long avoided_cnt;  /* Of those, pages then used. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func destroy_page;
+static void release_page (struct page *);
+
+/* Creates the supplemental page table for the current process.
+   Returns true if successful, false on failure. */
+bool
+page_table_init (void) 
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->pages == NULL);
+  t->pages = malloc (sizeof *t->pages);
+  if (t->pages == NULL)
+    return false;
+  if (!hash_init (t->pages, page_hash, page_less, NULL))
+    {
+      free (t->pages);
+      t->pages = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Destroys the current process's supplemental page table,
+   unmapping its pages and releasing their frames.  Must be called
+   before the process's page directory is destroyed. */
+void
+page_exit (void) 
+{
+  struct hash *h = thread_current ()->pages;
+  if (h != NULL)
+    {
+      thread_current ()->pages = NULL;
+      hash_destroy (h, destroy_page);
+      free (h);
+    }
+}
+
+/* Adds a mapping for user virtual address VADDR to the current
+   process's page table.  The page starts out zero-filled and
+   non-resident; the caller may set up file backing in the
+   returned page.  Fails if VADDR is already mapped or if memory
+   allocation fails.  Returns the new page if successful, a null
+   pointer on failure. */
+struct page *
+page_allocate (void *vaddr, bool read_only) 
+{
+  struct thread *t = thread_current ();
+  struct page *p = malloc (sizeof *p);
+
+  if (p != NULL) 
+    {
+      p->addr = pg_round_down (vaddr);
+      p->read_only = read_only;
+      p->thread = t;
+      p->frame = NULL;
+      p->sector = SWAP_NONE;
+      p->private = true;
+      p->mapped_ahead = false;
+      p->clock_accessed = p->sample_accessed = false;
+      p->ws_epoch = 0;
+      p->file = NULL;
+      p->file_offset = 0;
+      p->file_bytes = 0;
+
+      if (hash_insert (t->pages, &p->hash_elem) != NULL) 
+        {
+          /* Already mapped. */
+          free (p);
+          p = NULL;
+        }
+    }
+  return p;
+}
+
+/* Shares resident private page P of another process with page C
+   of the current process, copy-on-write.  P must have a locked
+   frame.
+   Returns true if successful, false if memory allocation
+   failed. */
+static bool
+share_page (struct page *p, struct page *c) 
+{
+  uint32_t *ppd = p->thread->pagedir;
+  uint32_t *cpd = c->thread->pagedir;
+  bool dirty = pagedir_is_dirty (ppd, p->addr);
+
+  if (!pagedir_set_page (cpd, c->addr, p->frame->base, false))
+    return false;
+  pagedir_set_dirty (cpd, c->addr, dirty);
+
+  if (!p->read_only) 
+    {
+      /* Write-protect P, keeping its dirty bit. */
+      pagedir_clear_page (ppd, p->addr);
+      pagedir_set_page (ppd, p->addr, p->frame->base, false);
+      pagedir_set_dirty (ppd, p->addr, dirty);
+    }
+
+  frame_attach (p->frame, c);
+  c->frame = p->frame;
+  return true;
+}
+
+/* Copies PARENT_PAGES, the page table of a process that is
+   forking and must not run meanwhile, into the current process's
+   page table, which must be empty.  Private pages that are
+   resident share their frames copy-on-write, and pages in swap
+   share their swap slots.  File-backed pages are given the files
+   that FILE_FUNC, called with AUX, returns for the parent's
+   files.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+page_fork (struct hash *parent_pages, page_file_func *file_func, void *aux) 
+{
+  struct hash_iterator i;
+
+  hash_first (&i, parent_pages);
+  while (hash_next (&i)) 
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      struct page *c = page_allocate (p->addr, p->read_only);
+      bool success = true;
+
+      if (c == NULL)
+        return false;
+      c->private = p->private;
+      c->file = p->file != NULL ? file_func (p->file, aux) : NULL;
+      c->file_offset = p->file_offset;
+      c->file_bytes = p->file_bytes;
+
+      /* A mapped file page is found again through the shared
+         frame table when the child touches it. */
+      frame_lock (p);
+      if (p->private) 
+        {
+          c->sector = p->sector;
+          swap_share (c);
+          if (p->frame != NULL)
+            success = share_page (p, c);
+        }
+      if (p->frame != NULL)
+        frame_unlock (p->frame);
+      if (!success)
+        return false;
+    }
+  return true;
+}
+
+/* Evicts the page containing address VADDR, if any, and removes
+   it from the current process's page table, writing it back to
+   its file first if it belongs to a file mapping and was
+   modified. */
+void
+page_deallocate (void *vaddr) 
+{
+  struct page *p = page_for_addr (vaddr);
+  if (p != NULL) 
+    {
+      hash_delete (thread_current ()->pages, &p->hash_elem);
+      release_page (p);
+    }
+}
+
+/* Returns the page containing the given virtual ADDRESS in the
+   current process, or a null pointer if no such page exists. */
+struct page *
+page_for_addr (const void *address) 
+{
+  struct hash *h = thread_current ()->pages;
+  struct page p;
+  struct hash_elem *e;
+
+  if (h == NULL || !is_user_vaddr (address))
+    return NULL;
+
+  p.addr = pg_round_down (address);
+  e = hash_find (h, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Reads page P's data into its frame, which must be locked.
+   Returns true if successful, false on failure. */
+static bool
+read_page (struct page *p) 
+{
+  uint8_t *kpage = p->frame->base;
+  off_t read_bytes = 0;
+
+  if (p->sector != SWAP_NONE) 
+    return swap_in (p);
+  else if (p->file != NULL) 
+    {
+      lock_acquire (&fs_lock);
+      read_bytes = file_read_at (p->file, kpage, p->file_bytes,
+                                 p->file_offset);
+      lock_release (&fs_lock);
+      if (read_bytes != p->file_bytes)
+        return false;
+    }
+  memset (kpage + read_bytes, 0, PGSIZE - read_bytes);
+  return true;
+}
+
+/* Writes page P, which must have a locked frame, back to its
+   file.
+   Returns true if successful, false on failure. */
+static bool
+write_back (struct page *p) 
+{
+  off_t written;
+
+  ASSERT (!p->private && p->file != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  lock_acquire (&fs_lock);
+  written = file_write_at (p->file, p->frame->base, p->file_bytes,
+                           p->file_offset);
+  lock_release (&fs_lock);
+  return written == p->file_bytes;
+}
+
+/* Returns true if page P's data can be shared with every other
+   process that has the same page of the same file: that is, if P
+   belongs to a file mapping, or if it is a read-only page read
+   straight from a file, such as the code of a program. */
+static bool
+is_shareable (struct page *p) 
+{
+  return (!p->private
+          || (p->read_only && p->file != NULL && p->sector == SWAP_NONE));
+}
+
+/* Locks a frame for page P and pages it in.  If P is shareable
+   and another process already has the same page of the file in
+   memory, P shares that frame.
+   Returns true if successful, false on failure. */
+static bool
+do_page_in (struct page *p) 
+{
+  bool fill = true;
+
+  if (is_shareable (p))
+    p->frame = frame_share_and_lock (p, file_get_inode (p->file),
+                                     p->file_offset, p->file_bytes, &fill);
+  else
+    p->frame = frame_alloc_and_lock (p);
+  if (p->frame == NULL)
+    return false;
+
+  if (fill && !read_page (p))
+    {
+      frame_free (p->frame);
+      return false;
+    }
+  return true;
+}
+
+/* Returns true if page P, which must have a locked frame, is a
+   private page that shares its frame copy-on-write with other
+   pages. */
+static bool
+is_copy_on_write (struct page *p) 
+{
+  return p->private && list_size (&p->frame->pages) > 1;
+}
+
+/* Maps page P, which must have a locked frame, into its
+   process's page directory, unless it is already mapped.  The
+   mapping is read-only if P is read-only or copy-on-write.
+   Returns true if successful, false if memory allocation
+   failed. */
+static bool
+map_page (struct page *p) 
+{
+  uint32_t *pd = p->thread->pagedir;
+
+  return (pagedir_get_page (pd, p->addr) != NULL
+          || pagedir_set_page (pd, p->addr, p->frame->base,
+                               !p->read_only && !is_copy_on_write (p)));
+}
+
+/* Maps private page P, which must have a locked frame,
+   writable, first moving it to a copy of its frame if it is
+   copy-on-write.  P's frame is locked on return, even on
+   failure.
+   Returns true if successful, false on failure. */
+static bool
+make_writable (struct page *p) 
+{
+  uint32_t *pd = p->thread->pagedir;
+  bool dirty;
+
+  ASSERT (p->private && !p->read_only);
+
+  dirty = pagedir_is_dirty (pd, p->addr);
+  pagedir_clear_page (pd, p->addr);
+  if (is_copy_on_write (p)) 
+    {
+      if (frame_copy_and_lock (p) == NULL) 
+        {
+          pagedir_set_page (pd, p->addr, p->frame->base, false);
+          pagedir_set_dirty (pd, p->addr, dirty);
+          return false;
+        }
+
+      /* The copy is about to be written, so it will no longer
+         match P's swap slot. */
+      dirty = true;
+    }
+  if (!pagedir_set_page (pd, p->addr, p->frame->base, true))
+    return false;
+  pagedir_set_dirty (pd, p->addr, dirty);
+  return true;
+}
+
+/* Returns true if an access to ADDRESS by the current process
+   should grow its stack. */
+static bool
+is_stack_access (const void *address) 
+{
+  const uint8_t *esp = thread_current ()->user_esp;
+  const uint8_t *addr = address;
+
+  /* The PUSHA instruction faults 32 bytes below the stack
+     pointer, so that is as low as a legitimate push can reach.
+     The stack size is compared in pages, so that a huge "-sl"
+     limit cannot wrap the lowest stack address around. */
+  return (addr < (uint8_t *) PHYS_BASE
+          && DIV_ROUND_UP ((size_t) ((uint8_t *) PHYS_BASE - addr), PGSIZE)
+             <= stack_page_limit
+          && esp != NULL
+          && addr + 32 >= esp);
+}
+
+/* Counts page P, which must have a locked frame, as a fault
+   avoided if it was mapped ahead of a fault and has since been
+   accessed. */
+static void
+note_access (struct page *p) 
+{
+  if (p->mapped_ahead && pagedir_is_accessed (p->thread->pagedir, p->addr))
+    {
+      avoided_cnt++;
+      p->mapped_ahead = false;
+    }
+}
+
+/* Returns true if the current process's page faults are moving
+   forward through memory, now that it has faulted on page P. */
+static bool
+is_sequential (struct page *p) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *last = t->last_fault;
+  uint8_t *addr = p->addr;
+
+  t->last_fault = addr;
+  return (last != NULL && addr > last
+          && addr <= last + (fault_around_pages + 1) * PGSIZE);
+}
+
+/* Maps the pages in the fault-around window containing page P
+   that are not yet mapped, but whose data is already in memory.
+   P itself must already be mapped. */
+static void
+fault_around (struct page *p) 
+{
+  uint8_t *start = (uint8_t *) p->addr
+                   - pg_no (p->addr) % fault_around_pages * PGSIZE;
+  size_t i;
+
+  for (i = 0; i < fault_around_pages; i++)
+    {
+      struct page *q = page_for_addr (start + i * PGSIZE);
+
+      if (q == NULL || q == p)
+        continue;
+      frame_lock (q);
+      if (q->frame != NULL) 
+        {
+          frame_unlock (q->frame);
+          continue;
+        }
+
+      if (is_shareable (q))
+        q->frame = frame_find_shared_and_lock (q, file_get_inode (q->file),
+                                               q->file_offset,
+                                               q->file_bytes);
+      if (q->frame == NULL)
+        continue;
+
+      if (map_page (q)) 
+        {
+          q->mapped_ahead = true;
+          around_cnt++;
+        }
+      frame_unlock (q->frame);
+    }
+}
+
+/* Asks for the file pages in the fault-around window after the
+   one containing page P to be read ahead. */
+static void
+read_ahead (struct page *p) 
+{
+  uint8_t *start = (uint8_t *) p->addr
+                   + (fault_around_pages
+                      - pg_no (p->addr) % fault_around_pages) * PGSIZE;
+  size_t i;
+
+  for (i = 0; i < fault_around_pages; i++)
+    {
+      struct page *q = page_for_addr (start + i * PGSIZE);
+
+      /* Q's frame is only a hint here: prefetch() checks again
+         whether the data is in memory. */
+      if (q != NULL && q->frame == NULL && is_shareable (q))
+        prefetch_request (file_get_inode (q->file), q->file_offset,
+                          q->file_bytes);
+    }
+}
+
+/* Faults in the page containing FAULT_ADDR, first adding it to
+   the stack if that is what the access calls for, and maps the
+   pages around it as described at fault_around_pages.
+   Returns true if successful, false on failure. */
+bool
+page_in (void *fault_addr) 
+{
+  struct page *p = page_for_addr (fault_addr);
+  bool success;
+
+  if (p == NULL && is_stack_access (fault_addr))
+    p = page_allocate (fault_addr, false);
+  if (p == NULL)
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL && !do_page_in (p))
+    return false;
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  success = map_page (p);
+  p->mapped_ahead = false;
+  frame_unlock (p->frame);
+
+  if (success && fault_around_pages > 1) 
+    {
+      fault_around (p);
+      if (is_sequential (p))
+        read_ahead (p);
+    }
+  return success;
+}
+
+/* Handles a write by the current process to the page
+   containing FAULT_ADDR that faulted because the page is mapped
+   read-only, which happens when the page is shared copy-on-write
+   after fork().
+   Returns true if the write may be retried, false if the page
+   really is read-only. */
+bool
+page_copy_on_write (void *fault_addr) 
+{
+  struct page *p = page_for_addr (fault_addr);
+  bool success;
+
+  if (p == NULL || p->read_only || !p->private)
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL)
+    {
+      /* Evicted since the fault.  Page it in again. */
+      return page_in (fault_addr);
+    }
+  success = make_writable (p);
+  frame_unlock (p->frame);
+  return success;
+}
+
+/* Pages in the page containing ADDR, if necessary, and locks its
+   frame into memory, so that the kernel can access it without
+   faulting while it holds locks that the page fault handler may
+   need.  Fails if ADDR is not mapped, or if WILL_WRITE is true
+   and the page is read-only.
+   Returns true if successful, false on failure. */
+bool
+page_lock (const void *addr, bool will_write) 
+{
+  struct page *p = page_for_addr (addr);
+
+  if (p == NULL && is_stack_access (addr))
+    p = page_allocate ((void *) addr, false);
+  if (p == NULL || (p->read_only && will_write))
+    return false;
+
+  frame_lock (p);
+  if (p->frame == NULL && !do_page_in (p))
+    return false;
+  if (will_write && p->private ? !make_writable (p) : !map_page (p)) 
+    {
+      frame_unlock (p->frame);
+      return false;
+    }
+  return true;
+}
+
+/* Unlocks the page containing ADDR, which must have been locked
+   with page_lock(). */
+void
+page_unlock (const void *addr) 
+{
+  struct page *p = page_for_addr (addr);
+
+  ASSERT (p != NULL && p->frame != NULL);
+  frame_unlock (p->frame);
+}
+
+/* Returns true if page P, which must have a locked frame, has
+   been modified since it was last read in or written out, so
+   that evicting it requires writing it to swap. */
+bool
+page_is_dirty (struct page *p) 
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  return pagedir_is_dirty (p->thread->pagedir, p->addr);
+}
+
+/* Clears the dirty bits of every page that maps locked frame F.
+   Returns true if any of them was set. */
+static bool
+clear_dirty (struct frame *f) 
+{
+  struct list_elem *e;
+  bool dirty = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (pagedir_is_dirty (p->thread->pagedir, p->addr)) 
+        {
+          pagedir_set_dirty (p->thread->pagedir, p->addr, false);
+          dirty = true;
+        }
+    }
+  return dirty;
+}
+
+/* Sets the dirty bit of every page that maps locked frame F. */
+static void
+set_dirty (struct frame *f) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_set_dirty (p->thread->pagedir, p->addr, true);
+    }
+}
+
+/* Evicts the pages in frame F, which must be locked.
+
+   If any of them was modified, F is written back to its file, if
+   it is a shared file page, or else to swap.  In the latter case
+   the CNT private frames in NEIGHBORS, which must also be locked,
+   are written in the same batch if they are dirty too.  They stay
+   resident, but become clean, so evicting them later costs no
+   I/O.
+
+   Returns true if successful, false if F was modified and could
+   not be written out. */
+bool
+page_out (struct frame *f, struct frame *neighbors[], size_t cnt) 
+{
+  struct frame *batch[SWAP_CLUSTER];
+  size_t batch_cnt, written;
+  struct list_elem *e;
+  bool dirty = false;
+  bool success;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (!list_empty (&f->pages));
+  ASSERT (cnt < SWAP_CLUSTER);
+
+  /* Mark the pages not present in their page tables, forcing
+     accesses by their processes to fault and wait on the frame
+     lock.  This must happen before checking the dirty bits, to
+     prevent a race with a process writing to the page. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+      if (pagedir_is_dirty (p->thread->pagedir, p->addr))
+        dirty = true;
+    }
+
+  if (!dirty) 
+    {
+      /* Its file, its swap slot, or zeroes still hold the same
+         data, so just drop it. */
+      success = true;
+    }
+  else if (f->inode != NULL)
+    success = write_back (list_entry (list_front (&f->pages),
+                                      struct page, frame_elem));
+  else
+    {
+      /* Clear each neighbor's dirty bits before writing it, so
+         that a write by its owner during the copy dirties it
+         again. */
+      batch[0] = f;
+      batch_cnt = 1;
+      for (i = 0; i < cnt; i++)
+        {
+          ASSERT (lock_held_by_current_thread (&neighbors[i]->lock));
+          if (clear_dirty (neighbors[i]))
+            batch[batch_cnt++] = neighbors[i];
+        }
+
+      /* If swap is too fragmented for the whole batch, write just
+         F.  Neighbors that were not written must be dirtied
+         again, or their data would be lost when they are
+         evicted. */
+      if (swap_out (batch, batch_cnt))
+        written = batch_cnt;
+      else if (batch_cnt > 1 && swap_out (batch, 1))
+        written = 1;
+      else
+        written = 0;
+      success = written > 0;
+      for (i = written > 1 ? written : 1; i < batch_cnt; i++)
+        set_dirty (batch[i]);
+    }
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (success)
+        p->frame = NULL;
+      else 
+        {
+          /* Could not write it out.  Restore the mapping, as
+             map_page() would make it, and the dirty bit of each
+             page that was dirty, so that we try again next time.
+             The not-present PTE still holds its dirty bit. */
+          bool was_dirty = pagedir_is_dirty (p->thread->pagedir, p->addr);
+
+          pagedir_set_page (p->thread->pagedir, p->addr, f->base,
+                            !p->read_only && !is_copy_on_write (p));
+          if (was_dirty)
+            pagedir_set_dirty (p->thread->pagedir, p->addr, true);
+        }
+    }
+  return success;
+}
+
+/* Moves page P's accessed bit from the page table into the
+   copies that the clock hand and working set sampling each
+   consume, so that neither hides accesses from the other.
+   P must have a frame locked into memory. */
+static void
+collect_accessed (struct page *p) 
+{
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  note_access (p);
+  if (pagedir_is_accessed (p->thread->pagedir, p->addr)) 
+    {
+      pagedir_set_accessed (p->thread->pagedir, p->addr, false);
+      p->clock_accessed = p->sample_accessed = true;
+    }
+}
+
+/* Returns true if page P's data has been accessed recently,
+   false otherwise, and clears the accessed bit so that P gets
+   only one more chance.
+   P must have a frame locked into memory. */
+bool
+page_accessed_recently (struct page *p) 
+{
+  bool was_accessed;
+
+  collect_accessed (p);
+  was_accessed = p->clock_accessed;
+  p->clock_accessed = false;
+  return was_accessed;
+}
+
+/* Returns true if page P's data has been accessed since the last
+   call, for working set sampling.
+   P must have a frame locked into memory. */
+bool
+page_used_since_sample (struct page *p) 
+{
+  bool was_accessed;
+
+  collect_accessed (p);
+  was_accessed = p->sample_accessed;
+  p->sample_accessed = false;
+  return was_accessed;
+}
+
+/* Prints fault-around statistics. */
+void
+page_print_stats (void) 
+{
+  printf ("Page: %llu pages mapped around faults, %llu faults avoided\n",
+          around_cnt, avoided_cnt);
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return ((uintptr_t) p->addr) >> PGBITS;
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED) 
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->addr < b->addr;
+}
+
+/* Unmaps page P, writing it back to its file first if it
+   belongs to a file mapping and was modified, releases its frame
+   and swap slot, and frees it. */
+static void
+release_page (struct page *p) 
+{
+  frame_lock (p);
+  if (p->frame != NULL)
+    {
+      /* The frame belongs to the frame table, so it must not be
+         freed along with the page directory. */
+      note_access (p);
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+      if (!p->private && pagedir_is_dirty (p->thread->pagedir, p->addr))
+        write_back (p);
+      frame_detach (p->frame, p);
+    }
+  swap_free (p);
+  free (p);
+}
+
+/* Releases the page that E refers to. */
+static void
+destroy_page (struct hash_elem *e, void *aux UNUSED) 
+{
+  release_page (hash_entry (e, struct page, hash_elem));
+}
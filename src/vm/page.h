@@ -0,0 +1,79 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* A virtual page of a user process, as recorded in the process's
+   supplemental page table.  The page is not necessarily resident:
+   until it is first touched, it only records where its contents
+   come from. */
+struct page
+  {
+    void *addr;                 /* User virtual address. */
+    bool read_only;             /* Read-only page? */
+    struct thread *thread;      /* Owning thread. */
+    struct hash_elem hash_elem; /* struct thread `pages' hash element. */
+
+    struct frame *frame;        /* Page frame, or null if not resident. */
+    struct list_elem frame_elem; /* struct frame `pages' list element. */
+    block_sector_t sector;      /* First swap sector, or SWAP_NONE. */
+
+    /* Accessed bit, as taken out of the page table for the clock
+       hand and for working set sampling (see workset.c). */
+    bool clock_accessed;        /* Accessed since clock hand passed? */
+    bool sample_accessed;       /* Accessed since last sample? */
+    unsigned ws_epoch;          /* Last sample that saw an access. */
+
+    /* File backing.  If FILE is null, the page is zero-filled.
+       Otherwise FILE_BYTES bytes are read from FILE at
+       FILE_OFFSET and the rest of the page is zeroed.  A private
+       page is written to swap when it is modified; a page that is
+       not private belongs to a file mapping, shares its frame
+       with every other mapping of the same page of the file, and
+       is written back to FILE. */
+    bool private;               /* False to write back to FILE. */
+    bool mapped_ahead;          /* Mapped without a fault, not yet used? */
+    struct file *file;          /* File. */
+    off_t file_offset;          /* Offset in file. */
+    off_t file_bytes;           /* Bytes to read/write, 1...PGSIZE. */
+  };
+
+/* Maximum size of a process's stack, in pages. */
+#define STACK_PAGE_LIMIT_DEFAULT 2048   /* 8 MB. */
+extern size_t stack_page_limit;
+
+/* Size of the fault-around window, in pages. */
+#define FAULT_AROUND_DEFAULT 8
+extern size_t fault_around_pages;
+
+/* Returns the forking child's copy of the parent's FILE, for
+   page_fork(). */
+typedef struct file *page_file_func (struct file *file, void *aux);
+
+bool page_table_init (void);
+void page_exit (void);
+bool page_fork (struct hash *parent_pages, page_file_func *, void *aux);
+
+struct frame;
+
+struct page *page_allocate (void *, bool read_only);
+void page_deallocate (void *vaddr);
+struct page *page_for_addr (const void *address);
+bool page_in (void *fault_addr);
+bool page_copy_on_write (void *fault_addr);
+bool page_out (struct frame *, struct frame *neighbors[], size_t cnt);
+bool page_is_dirty (struct page *);
+bool page_accessed_recently (struct page *);
+bool page_used_since_sample (struct page *);
+
+bool page_lock (const void *, bool will_write);
+void page_unlock (const void *);
+
+void page_print_stats (void);
+
+#endif
@@ -0,0 +1,149 @@
+#include "vm/prefetch.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "vm/frame.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
+
+/* Asynchronous read-ahead of file pages.
+
+   When a process faults its way sequentially through a file
+   mapping or a program's code, page_in() asks for the pages just
+   beyond the ones it maps.  A kernel thread reads each of them
+   into a free frame and enters the frame in the shared frame
+   table, without mapping it in any process, so that the
+   process's next faults, or fault-around, find it there without
+   waiting for the disk.  Read-ahead never evicts anything: if no
+   frame is free, the request is dropped. */
+
+/* A page to read ahead. */
+struct request 
+  {
+    struct inode *inode;        /* Inode, with a reference held. */
+    off_t offset;               /* Offset in inode. */
+    off_t length;               /* Bytes to read, 1...PGSIZE. */
+  };
+
+/* Queue of requests, as a ring buffer. */
+#define QUEUE_SIZE 32
+static struct request queue[QUEUE_SIZE];
+static size_t head, tail;       /* Next to dequeue, next to enqueue. */
+static struct lock queue_lock;
+static struct semaphore queue_cnt;
+
+/* Statistics. */
+static unsigned long long read_cnt;     /* Pages read ahead. */
+static unsigned long long skip_cnt;     /* Requests dropped or not needed. */
+
+static thread_func prefetch_thread NO_RETURN;
+
+/* Starts the read-ahead thread. */
+void
+prefetch_init (void) 
+{
+  lock_init (&queue_lock);
+  sema_init (&queue_cnt, 0);
+  thread_create ("prefetch", PRI_DEFAULT, prefetch_thread, NULL);
+}
+
+/* Asks for LENGTH bytes of INODE at OFFSET to be read into a
+   shared frame in the background.  Does not wait. */
+void
+prefetch_request (struct inode *inode, off_t offset, off_t length) 
+{
+  bool queued = false;
+
+  ASSERT (length > 0 && length <= PGSIZE);
+
+  /* Take the request's reference before queue_lock, so that
+     queue_lock is never held while waiting for fs_lock. */
+  lock_acquire (&fs_lock);
+  inode_reopen (inode);
+  lock_release (&fs_lock);
+
+  lock_acquire (&queue_lock);
+  if ((tail + 1) % QUEUE_SIZE != head) 
+    {
+      struct request *r = &queue[tail];
+
+      r->inode = inode;
+      r->offset = offset;
+      r->length = length;
+      tail = (tail + 1) % QUEUE_SIZE;
+      queued = true;
+    }
+  else
+    skip_cnt++;
+  lock_release (&queue_lock);
+
+  if (queued)
+    sema_up (&queue_cnt);
+  else 
+    {
+      lock_acquire (&fs_lock);
+      inode_close (inode);
+      lock_release (&fs_lock);
+    }
+}
+
+/* Reads the page described by R into a free frame, unless it is
+   already in memory or no frame is free. */
+static void
+prefetch (struct request *r) 
+{
+  struct frame *f = frame_prefetch_and_lock (r->inode, r->offset, r->length);
+  off_t read_bytes;
+
+  if (f == NULL) 
+    {
+      skip_cnt++;
+      return;
+    }
+
+  lock_acquire (&fs_lock);
+  read_bytes = inode_read_at (r->inode, f->base, r->length, r->offset);
+  lock_release (&fs_lock);
+  if (read_bytes != r->length) 
+    {
+      frame_free (f);
+      return;
+    }
+  memset ((uint8_t *) f->base + r->length, 0, PGSIZE - r->length);
+  read_cnt++;
+  frame_unlock (f);
+}
+
+/* Read-ahead thread.  Serves requests in the order they were
+   made. */
+static void
+prefetch_thread (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      struct request r;
+
+      sema_down (&queue_cnt);
+      lock_acquire (&queue_lock);
+      r = queue[head];
+      head = (head + 1) % QUEUE_SIZE;
+      lock_release (&queue_lock);
+
+      prefetch (&r);
+
+      lock_acquire (&fs_lock);
+      inode_close (r.inode);
+      lock_release (&fs_lock);
+    }
+}
+
+/* Prints read-ahead statistics. */
+void
+prefetch_print_stats (void) 
+{
+  printf ("Prefetch: %llu pages read ahead, %llu requests skipped\n",
+          read_cnt, skip_cnt);
+}
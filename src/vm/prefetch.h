@@ -0,0 +1,12 @@
+#ifndef VM_PREFETCH_H
+#define VM_PREFETCH_H
+
+#include "filesys/off_t.h"
+
+struct inode;
+
+void prefetch_init (void);
+void prefetch_request (struct inode *, off_t offset, off_t length);
+void prefetch_print_stats (void);
+
+#endif
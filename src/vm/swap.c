@@ -0,0 +1,250 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/zswap.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap manager.
+
+   The swap device is divided into page-size slots of
+   PAGE_SECTORS consecutive sectors, and SWAP_BITMAP records which
+   slots are in use.  A page keeps its slot after it is swapped
+   back in, so that if it is evicted again without having been
+   modified, it can simply be dropped instead of rewritten.
+
+   After fork(), a parent and child may hold the same slot, so
+   SLOT_REFS counts the pages that hold each slot, and a slot is
+   released only when the last of them lets go of it.
+
+   When compressed swap is enabled, a slot's contents are kept in
+   the compressed pool if they fit, and SLOT_ZOBJ records where;
+   only the rest are written to the slot's sectors on the swap
+   device.  Either way the slot stays reserved on the device, so
+   the pool never changes how many pages can be swapped out. */
+
+/* The swap device. */
+static struct block *swap_device;
+
+/* Used swap slots. */
+static struct bitmap *swap_bitmap;
+
+/* Number of pages holding each slot. */
+static unsigned *slot_refs;
+
+/* Compressed pool object holding each slot, or ZSWAP_NONE. */
+static unsigned *slot_zobj;
+
+/* Protects swap_bitmap and slot_refs. */
+static struct lock swap_lock;
+
+/* Number of sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Statistics. */
+static unsigned long long swap_in_cnt;      /* Pages read. */
+static unsigned long long zswap_in_cnt;     /* ...of which from the pool. */
+static unsigned long long swap_out_cnt;     /* Pages written. */
+static unsigned long long zswap_out_cnt;    /* ...of which to the pool. */
+static unsigned long long swap_write_cnt;   /* Batched device writes. */
+
+/* Sets up swap. */
+void
+swap_init (void) 
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL) 
+    {
+      printf ("no swap device--swap disabled\n");
+      swap_bitmap = bitmap_create (0);
+    }
+  else
+    swap_bitmap = bitmap_create (block_size (swap_device) / PAGE_SECTORS);
+  if (swap_bitmap == NULL)
+    PANIC ("couldn't create swap bitmap");
+  if (bitmap_size (swap_bitmap) > 0) 
+    {
+      size_t i;
+
+      slot_refs = calloc (bitmap_size (swap_bitmap), sizeof *slot_refs);
+      slot_zobj = malloc (bitmap_size (swap_bitmap) * sizeof *slot_zobj);
+      if (slot_refs == NULL || slot_zobj == NULL)
+        PANIC ("couldn't create swap slot tables");
+      for (i = 0; i < bitmap_size (swap_bitmap); i++)
+        slot_zobj[i] = ZSWAP_NONE;
+      zswap_init ();
+    }
+}
+
+/* Drops one reference to the slot that starts at SECTOR,
+   releasing the slot if that was the last one.
+   The caller must hold swap_lock. */
+static void
+release_slot (block_sector_t sector) 
+{
+  size_t slot = sector / PAGE_SECTORS;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+  ASSERT (slot_refs[slot] > 0);
+  if (--slot_refs[slot] == 0) 
+    {
+      if (slot_zobj[slot] != ZSWAP_NONE) 
+        {
+          zswap_free (slot_zobj[slot]);
+          slot_zobj[slot] = ZSWAP_NONE;
+        }
+      bitmap_reset (swap_bitmap, slot);
+    }
+}
+
+/* Reads page P, which must have a locked frame and a swap slot,
+   in from swap.  P keeps its slot.
+   Returns true if successful, false on failure. */
+bool
+swap_in (struct page *p) 
+{
+  size_t slot = p->sector / PAGE_SECTORS;
+  size_t i;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+  ASSERT (p->sector != SWAP_NONE);
+
+  if (slot_zobj[slot] != ZSWAP_NONE) 
+    {
+      zswap_load (slot_zobj[slot], p->frame->base);
+      zswap_in_cnt++;
+    }
+  else
+    for (i = 0; i < PAGE_SECTORS; i++)
+      block_read (swap_device, p->sector + i,
+                  (uint8_t *) p->frame->base + i * BLOCK_SECTOR_SIZE);
+  swap_in_cnt++;
+  return true;
+}
+
+/* Writes the CNT frames in FRAMES, each of which must be
+   locked, out to swap as a single run of consecutive slots, and
+   records each frame's new slot in every page that maps it.  Any
+   slots those pages held before are released, but only once the
+   new run has been found, so that on failure every page keeps
+   the slot it had.
+   Returns true if successful, false if swap is full or
+   disabled. */
+bool
+swap_out (struct frame *frames[], size_t cnt) 
+{
+  struct list_elem *e;
+  size_t slot;
+  size_t disk_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  if (slot == BITMAP_ERROR) 
+    {
+      lock_release (&swap_lock);
+      return false; 
+    }
+  for (i = 0; i < cnt; i++)
+    for (e = list_begin (&frames[i]->pages); e != list_end (&frames[i]->pages);
+         e = list_next (e))
+      {
+        struct page *p = list_entry (e, struct page, frame_elem);
+        if (p->sector != SWAP_NONE) 
+          {
+            release_slot (p->sector);
+            p->sector = SWAP_NONE;
+          }
+      }
+  lock_release (&swap_lock);
+
+  for (i = 0; i < cnt; i++) 
+    {
+      struct frame *f = frames[i];
+      block_sector_t sector = (slot + i) * PAGE_SECTORS;
+      size_t j;
+
+      ASSERT (lock_held_by_current_thread (&f->lock));
+
+      if (zswap_store (f->base, &slot_zobj[slot + i]))
+        zswap_out_cnt++;
+      else 
+        {
+          for (j = 0; j < PAGE_SECTORS; j++)
+            block_write (swap_device, sector + j,
+                         (uint8_t *) f->base + j * BLOCK_SECTOR_SIZE);
+          disk_cnt++;
+        }
+      for (e = list_begin (&f->pages); e != list_end (&f->pages);
+           e = list_next (e))
+        {
+          list_entry (e, struct page, frame_elem)->sector = sector;
+          slot_refs[slot + i]++;
+        }
+    }
+  swap_out_cnt += cnt;
+  if (disk_cnt > 0)
+    swap_write_cnt++;
+  return true;
+}
+
+/* Adds a reference to page P's swap slot, which P has just
+   copied from another page, if it has one. */
+void
+swap_share (struct page *p) 
+{
+  if (p->sector != SWAP_NONE) 
+    {
+      lock_acquire (&swap_lock);
+      slot_refs[p->sector / PAGE_SECTORS]++;
+      lock_release (&swap_lock);
+    }
+}
+
+/* Releases page P's swap slot, if it has one. */
+void
+swap_free (struct page *p) 
+{
+  if (p->sector != SWAP_NONE) 
+    {
+      lock_acquire (&swap_lock);
+      release_slot (p->sector);
+      lock_release (&swap_lock);
+      p->sector = SWAP_NONE;
+    }
+}
+
+/* Prints swap statistics, including page rates over the time
+   since boot. */
+void
+swap_print_stats (void) 
+{
+  int64_t ticks = timer_ticks ();
+
+  if (swap_bitmap == NULL)
+    return;
+  if (ticks == 0)
+    ticks = 1;
+
+  printf ("Swap: %zu of %zu slots used, "
+          "%llu pages in (%llu from RAM, %llu from disk), "
+          "%llu pages out (%llu to RAM, %llu to disk in %llu writes), "
+          "%lld pages/s in, %lld pages/s out\n",
+          bitmap_count (swap_bitmap, 0, bitmap_size (swap_bitmap), true),
+          bitmap_size (swap_bitmap),
+          swap_in_cnt, zswap_in_cnt, swap_in_cnt - zswap_in_cnt,
+          swap_out_cnt, zswap_out_cnt, swap_out_cnt - zswap_out_cnt,
+          swap_write_cnt,
+          (int64_t) swap_in_cnt * TIMER_FREQ / ticks,
+          (int64_t) swap_out_cnt * TIMER_FREQ / ticks);
+  zswap_print_stats ();
+}
@@ -0,0 +1,24 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Sector value of a page that has no swap slot. */
+#define SWAP_NONE ((block_sector_t) -1)
+
+/* Maximum number of pages written to swap in one batch. */
+#define SWAP_CLUSTER 8
+
+struct frame;
+struct page;
+
+void swap_init (void);
+bool swap_in (struct page *);
+bool swap_out (struct frame *frames[], size_t cnt);
+void swap_share (struct page *);
+void swap_free (struct page *);
+void swap_print_stats (void);
+
+#endif
@@ -0,0 +1,221 @@
+#include "vm/workset.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Working sets and resident set limits.
+
+   A kernel thread samples every resident page each WS_INTERVAL
+   timer ticks.  A page whose accessed bit was set since the last
+   sample is stamped with the current sample number, and a
+   process's working set is estimated as the resident pages it
+   used in the last WS_WINDOW samples.  The same pass counts each
+   process's resident pages.  Pages in frames that are busy at
+   the time are missed, so both counts are estimates.
+
+   Each process has a soft limit on its resident set, inherited
+   from its parent.  Nothing stops a process from growing past
+   its limit, but while any process is over its limit, eviction
+   takes frames from such processes first, so that one process
+   streaming through memory pushes out its own pages rather than
+   everyone else's.
+
+   The per-process counters live in struct thread.  The sampling
+   thread alone writes rss_next and wss_next; it publishes them
+   as rss and wss with interrupts disabled at the end of each
+   pass, and eviction lowers rss, also with interrupts disabled,
+   as it takes pages away between passes. */
+
+/* Ticks between samples. */
+#define WS_INTERVAL (TIMER_FREQ / 4)
+
+/* Number of samples that make up the working set window. */
+#define WS_WINDOW 4
+
+/* Resident set limit of the first process. */
+size_t rss_limit_default = MEMSTAT_NO_LIMIT;
+
+/* Current sample number.  Starts past WS_WINDOW so that pages
+   stamped 0 are outside the window. */
+static unsigned epoch = WS_WINDOW;
+
+/* Number of processes over their limits at the last sample,
+   less those brought back under since by eviction. */
+static size_t over_limit_cnt;
+
+/* Statistics. */
+static unsigned long long sample_cnt;       /* Passes over memory. */
+static unsigned long long limit_evict_cnt;  /* Pages evicted over limit. */
+
+static thread_func workset_thread NO_RETURN;
+static frame_page_func sample_page;
+static thread_action_func publish_sample;
+
+/* Starts the sampling thread. */
+void
+workset_init (void)
+{
+  thread_create ("workset", PRI_DEFAULT, workset_thread, NULL);
+}
+
+/* Returns true if T is over its resident set limit. */
+bool
+workset_over_limit (const struct thread *t)
+{
+  return t->rss > t->rss_limit;
+}
+
+/* Returns true if any process is over its resident set
+   limit. */
+bool
+workset_any_over_limit (void)
+{
+  return over_limit_cnt > 0;
+}
+
+/* Records that one of T's pages was evicted.  T's frame must be
+   locked. */
+void
+workset_evicted (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+
+  t->evict_cnt++;
+  if (workset_over_limit (t))
+    {
+      limit_evict_cnt++;
+      if (--t->rss == t->rss_limit)
+        over_limit_cnt--;
+    }
+  else if (t->rss > 0)
+    t->rss--;
+  intr_set_level (old_level);
+}
+
+/* Auxiliary data for find_process(). */
+struct find_aux
+  {
+    tid_t tid;                  /* Process to find. */
+    struct thread *thread;      /* Its thread, once found. */
+  };
+
+/* Stores T in AUX if it is the process that AUX looks for. */
+static void
+find_process (struct thread *t, void *aux_)
+{
+  struct find_aux *aux = aux_;
+  if (t->tid == aux->tid && t->pages != NULL)
+    aux->thread = t;
+}
+
+/* Returns process TID's thread, or a null pointer if there is no
+   such process.  Interrupts must be off. */
+static struct thread *
+lookup_process (tid_t tid)
+{
+  struct find_aux aux;
+
+  aux.tid = tid;
+  aux.thread = NULL;
+  thread_foreach (find_process, &aux);
+  return aux.thread;
+}
+
+/* Stores process TID's memory use into *M.  Returns true if
+   successful, false if there is no such process. */
+bool
+workset_get (tid_t tid, struct memstat *m)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *t = lookup_process (tid);
+
+  if (t != NULL)
+    {
+      m->resident = t->rss;
+      m->working_set = t->wss;
+      m->resident_limit = t->rss_limit;
+      m->evicted = t->evict_cnt;
+    }
+  intr_set_level (old_level);
+  return t != NULL;
+}
+
+/* Sets process TID's resident set limit to LIMIT pages.  Returns
+   true if successful, false if there is no such process. */
+bool
+workset_set_limit (tid_t tid, size_t limit)
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *t = lookup_process (tid);
+
+  if (t != NULL)
+    {
+      bool was_over = workset_over_limit (t);
+      t->rss_limit = limit;
+      if (workset_over_limit (t) && !was_over)
+        over_limit_cnt++;
+      else if (!workset_over_limit (t) && was_over)
+        over_limit_cnt--;
+    }
+  intr_set_level (old_level);
+  return t != NULL;
+}
+
+/* Prints working set statistics. */
+void
+workset_print_stats (void)
+{
+  printf ("Workset: %llu samples, %llu pages evicted over limit\n",
+          sample_cnt, limit_evict_cnt);
+}
+
+/* Samples every resident page every WS_INTERVAL ticks. */
+static void
+workset_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+
+      timer_sleep (WS_INTERVAL);
+      epoch++;
+      frame_for_each_page (sample_page, NULL);
+
+      old_level = intr_disable ();
+      over_limit_cnt = 0;
+      thread_foreach (publish_sample, NULL);
+      intr_set_level (old_level);
+      sample_cnt++;
+    }
+}
+
+/* Counts resident page P, whose frame is locked, toward its
+   process's resident set, and toward its working set if it was
+   used recently. */
+static void
+sample_page (struct page *p, void *aux UNUSED)
+{
+  struct thread *t = p->thread;
+
+  if (page_used_since_sample (p))
+    p->ws_epoch = epoch;
+  t->rss_next++;
+  if (epoch - p->ws_epoch < WS_WINDOW)
+    t->wss_next++;
+}
+
+/* Makes the counts for T from the pass just completed current,
+   and starts T's counts for the next one. */
+static void
+publish_sample (struct thread *t, void *aux UNUSED)
+{
+  t->rss = t->rss_next;
+  t->wss = t->wss_next;
+  t->rss_next = t->wss_next = 0;
+  if (workset_over_limit (t))
+    over_limit_cnt++;
+}
@@ -0,0 +1,21 @@
+#ifndef VM_WORKSET_H
+#define VM_WORKSET_H
+
+#include <memstat.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+/* Resident set limit given to the first process, and inherited
+   from there, in pages. */
+extern size_t rss_limit_default;
+
+void workset_init (void);
+bool workset_over_limit (const struct thread *);
+bool workset_any_over_limit (void);
+void workset_evicted (struct thread *);
+bool workset_get (tid_t, struct memstat *);
+bool workset_set_limit (tid_t, size_t limit);
+void workset_print_stats (void);
+
+#endif
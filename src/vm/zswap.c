@@ -0,0 +1,272 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <lz.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Compressed swap pool.
+
+   Pages being swapped out are compressed and kept in a pool of
+   kernel pages set aside at startup, so that swapping them back
+   in costs a decompression instead of a disk read.  The swap
+   manager falls back to the swap device only for pages that do
+   not compress to half a page or less, or when the pool is full.
+
+   The pool is managed like zsmalloc: compressed pages are stored
+   as objects in size classes that are multiples of OBJ_ALIGN
+   bytes, and each pool page holds objects of a single class.  A
+   pool page with free objects is on its class's list, and a pool
+   page that holds no objects at all returns to the list of empty
+   pages so that any class can use it.  Each object starts with
+   its compressed length, and a free object holds the index of
+   the next free object in its pool page.
+
+   A handle names an object as its pool page index times
+   PAGE_OBJS plus its index within the page. */
+
+/* Object sizes are multiples of this many bytes. */
+#define OBJ_ALIGN 32
+
+/* Maximum objects per pool page. */
+#define PAGE_OBJS (PGSIZE / OBJ_ALIGN)
+
+/* Largest object, including its header.  A page that does not
+   compress to this size goes to the swap device instead. */
+#define MAX_OBJ (PGSIZE / 2)
+
+/* Number of size classes, with class 0 unused. */
+#define CLASS_CNT (MAX_OBJ / OBJ_ALIGN + 1)
+
+/* End of a free object chain. */
+#define NO_OBJ 0xffff
+
+/* Object header. */
+struct obj_header
+  {
+    uint16_t size;              /* Compressed bytes that follow. */
+  };
+
+/* A page of the pool. */
+struct pool_page
+  {
+    struct list_elem elem;      /* In class list or empty list. */
+    uint8_t *base;              /* Kernel virtual address. */
+    unsigned obj_size;          /* Object size, 0 if page is empty. */
+    unsigned used_cnt;          /* Objects in use. */
+    uint16_t free_obj;          /* First free object, or NO_OBJ. */
+  };
+
+/* Number of kernel pages to set aside for compressed swap. */
+size_t zswap_pages;
+
+static struct pool_page *pool;
+static size_t pool_cnt;
+
+/* Pool pages with free objects, by class. */
+static struct list partial[CLASS_CNT];
+
+/* Pool pages with no objects. */
+static struct list empty;
+
+/* Compressor work area and output buffer. */
+static void *work;
+static uint8_t *buffer;
+
+/* Protects the pool and the buffers above. */
+static struct lock zswap_lock;
+
+/* Statistics. */
+static size_t stored_cnt;                   /* Pages now in the pool. */
+static size_t stored_bytes;                 /* Their compressed size. */
+static size_t used_pages;                   /* Non-empty pool pages. */
+static size_t peak_pages;                   /* Maximum of used_pages. */
+static unsigned long long store_cnt;        /* Pages stored. */
+static unsigned long long reject_cnt;       /* Incompressible pages. */
+static unsigned long long full_cnt;         /* Pool full. */
+
+static uint8_t *obj_addr (unsigned handle);
+
+/* Sets aside zswap_pages kernel pages for the compressed pool,
+   or as many as are available.  Does nothing if zswap_pages is
+   0. */
+void
+zswap_init (void)
+{
+  size_t i;
+
+  lock_init (&zswap_lock);
+  list_init (&empty);
+  for (i = 0; i < CLASS_CNT; i++)
+    list_init (&partial[i]);
+  if (zswap_pages == 0)
+    return;
+
+  work = palloc_get_multiple (0, DIV_ROUND_UP (LZ_WORK_SIZE, PGSIZE));
+  buffer = palloc_get_page (0);
+  pool = malloc (zswap_pages * sizeof *pool);
+  if (work == NULL || buffer == NULL || pool == NULL)
+    PANIC ("couldn't allocate compressed swap");
+
+  for (pool_cnt = 0; pool_cnt < zswap_pages; pool_cnt++)
+    {
+      struct pool_page *pp = &pool[pool_cnt];
+
+      pp->base = palloc_get_page (0);
+      if (pp->base == NULL)
+        break;
+      pp->obj_size = 0;
+      pp->used_cnt = 0;
+      list_push_back (&empty, &pp->elem);
+    }
+  printf ("compressed swap: %zu pages\n", pool_cnt);
+}
+
+/* Compresses the page at PAGE into the pool, and on success
+   stores its handle in *HANDLE and returns true.  Returns false
+   if compressed swap is disabled, the page does not compress
+   well enough, or the pool is full. */
+bool
+zswap_store (const void *page, unsigned *handle)
+{
+  struct pool_page *pp;
+  struct obj_header *h;
+  size_t size, class;
+  unsigned obj;
+
+  if (pool_cnt == 0)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  size = lz_compress (page, PGSIZE, buffer, MAX_OBJ - sizeof *h, work);
+  if (size == 0)
+    {
+      reject_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  /* Find a pool page with a free object of the right class,
+     carving up an empty page if there is none. */
+  class = DIV_ROUND_UP (size + sizeof *h, OBJ_ALIGN);
+  if (!list_empty (&partial[class]))
+    pp = list_entry (list_front (&partial[class]), struct pool_page, elem);
+  else if (!list_empty (&empty))
+    {
+      unsigned obj_cnt;
+
+      pp = list_entry (list_pop_front (&empty), struct pool_page, elem);
+      pp->obj_size = class * OBJ_ALIGN;
+      obj_cnt = PGSIZE / pp->obj_size;
+      for (obj = 0; obj < obj_cnt; obj++)
+        *(uint16_t *) (pp->base + obj * pp->obj_size)
+          = obj + 1 < obj_cnt ? obj + 1 : NO_OBJ;
+      pp->free_obj = 0;
+      list_push_front (&partial[class], &pp->elem);
+      if (++used_pages > peak_pages)
+        peak_pages = used_pages;
+    }
+  else
+    {
+      full_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  /* Take the object. */
+  obj = pp->free_obj;
+  h = (struct obj_header *) (pp->base + obj * pp->obj_size);
+  pp->free_obj = *(uint16_t *) h;
+  if (pp->free_obj == NO_OBJ)
+    list_remove (&pp->elem);
+  pp->used_cnt++;
+
+  h->size = size;
+  memcpy (h + 1, buffer, size);
+  *handle = (pp - pool) * PAGE_OBJS + obj;
+
+  stored_cnt++;
+  stored_bytes += size;
+  store_cnt++;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* Decompresses the object with the given HANDLE into PAGE.
+   The object stays in the pool. */
+void
+zswap_load (unsigned handle, void *page)
+{
+  struct obj_header *h;
+  bool ok;
+
+  lock_acquire (&zswap_lock);
+  h = (struct obj_header *) obj_addr (handle);
+  ok = lz_decompress (h + 1, h->size, page, PGSIZE);
+  lock_release (&zswap_lock);
+  if (!ok)
+    PANIC ("compressed swap object %u is corrupt", handle);
+}
+
+/* Frees the object with the given HANDLE. */
+void
+zswap_free (unsigned handle)
+{
+  struct pool_page *pp = &pool[handle / PAGE_OBJS];
+  uint16_t *obj;
+
+  lock_acquire (&zswap_lock);
+  obj = (uint16_t *) obj_addr (handle);
+  stored_cnt--;
+  stored_bytes -= ((struct obj_header *) obj)->size;
+
+  if (pp->free_obj == NO_OBJ)
+    list_push_front (&partial[pp->obj_size / OBJ_ALIGN], &pp->elem);
+  *obj = pp->free_obj;
+  pp->free_obj = handle % PAGE_OBJS;
+  if (--pp->used_cnt == 0)
+    {
+      list_remove (&pp->elem);
+      pp->obj_size = 0;
+      list_push_front (&empty, &pp->elem);
+      used_pages--;
+    }
+  lock_release (&zswap_lock);
+}
+
+/* Prints compressed swap statistics. */
+void
+zswap_print_stats (void)
+{
+  if (pool_cnt == 0)
+    return;
+
+  printf ("Zswap: %zu pages in %zu of %zu pool pages (peak %zu), "
+          "compressed to %zu%%, %llu stored, %llu incompressible, "
+          "%llu pool full\n",
+          stored_cnt, used_pages, pool_cnt, peak_pages,
+          stored_cnt > 0 ? stored_bytes * 100 / (stored_cnt * PGSIZE) : 0,
+          store_cnt, reject_cnt, full_cnt);
+}
+
+/* Returns the address of the object with the given HANDLE.
+   The caller must hold zswap_lock. */
+static uint8_t *
+obj_addr (unsigned handle)
+{
+  struct pool_page *pp;
+
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+  ASSERT (handle / PAGE_OBJS < pool_cnt);
+
+  pp = &pool[handle / PAGE_OBJS];
+  ASSERT (pp->obj_size > 0);
+  ASSERT (handle % PAGE_OBJS < PGSIZE / pp->obj_size);
+  return pp->base + (handle % PAGE_OBJS) * pp->obj_size;
+}
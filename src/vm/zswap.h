@@ -0,0 +1,20 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Handle of a page that is not in the compressed pool. */
+#define ZSWAP_NONE ((unsigned) -1)
+
+/* Number of kernel pages to set aside for compressed swap,
+   0 to disable it. */
+extern size_t zswap_pages;
+
+void zswap_init (void);
+bool zswap_store (const void *page, unsigned *handle);
+void zswap_load (unsigned handle, void *page);
+void zswap_free (unsigned handle);
+void zswap_print_stats (void);
+
+#endif